@@ -0,0 +1,68 @@
+#!/bin/sh
+# Measures how render time of the random scene scales from 1 thread to every cpu.
+#
+# For each thread count a fresh renderd is started with the random scene mapped from the
+# scene cache, the same render is requested a few times and the fastest render_ms is
+# kept. Prints threads, render time, speedup over 1 thread and parallel efficiency.
+#
+# usage: ./bench_scaling.sh [--numa | --numa-nodes n] [width height spp [repeats]]
+#   --numa          pin threads per NUMA node and replicate the scene on every node
+#   --numa-nodes n  same with the cpus regrouped into n nodes (see renderd usage)
+# Thread counts are powers of two up to the number of cpus, plus the cpu count itself.
+# Run `make` first.
+
+set -e
+
+numa_flags=""
+case "$1" in
+    --numa) numa_flags="--numa"; shift ;;
+    --numa-nodes) numa_flags="--numa-nodes $2"; shift 2 ;;
+esac
+
+width=${1:-640}
+height=${2:-360}
+spp=${3:-16}
+repeats=${4:-3}
+cpus=$(getconf _NPROCESSORS_ONLN)
+
+work_dir=$(mktemp -d)
+socket="$work_dir/renderd.sock"
+trap 'kill $daemon 2>/dev/null; rm -rf "$work_dir"' EXIT
+
+thread_counts=""
+t=1
+while [ "$t" -lt "$cpus" ]; do
+    thread_counts="$thread_counts $t"
+    t=$((t * 2))
+done
+thread_counts="$thread_counts $cpus"
+
+echo "random scene ${width}x${height} spp=$spp, best of $repeats, $cpus cpus ${numa_flags}"
+echo "threads render_ms speedup efficiency"
+
+base=""
+for threads in $thread_counts; do
+    ./renderd --socket "$socket" --threads "$threads" --cache-dir "$work_dir" $numa_flags \
+        random 2>"$work_dir/renderd.log" &
+    daemon=$!
+    while ! ./render_client --socket "$socket" stats >/dev/null 2>&1; do sleep 0.1; done
+
+    best=""
+    i=0
+    while [ "$i" -lt "$repeats" ]; do
+        ms=$(./render_client --socket "$socket" render scene=random out="$work_dir/out.ppm" \
+                 width="$width" height="$height" spp="$spp" 2>/dev/null |
+             sed -n 's/.*render_ms=\([0-9.]*\).*/\1/p')
+        best=$(awk -v a="$best" -v b="$ms" 'BEGIN { print (a == "" || b < a) ? b : a }')
+        i=$((i + 1))
+    done
+
+    kill "$daemon"
+    wait "$daemon" 2>/dev/null || true
+    [ -n "$base" ] || base=$best
+    awk -v t="$threads" -v ms="$best" -v base="$base" \
+        'BEGIN { printf "%7d %9.1f %7.2f %9.0f%%\n", t, ms, base / ms, 100 * base / ms / t }'
+done
+
+# Warnings of the last daemon, e.g. pinning failures in a restricted cpuset
+grep -v -e "^Loaded" -e "^Listening" -e "^job" -e "^Replicated" "$work_dir/renderd.log" || true
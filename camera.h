@@ -23,6 +23,10 @@ private:
     Vec3 u, v, w;
     // Radius of camera lens
     double lens_radius;
+    // Vertical field of view in radians
+    double fov;
+    // Angle subtended by a single pixel, spread of the ray cone of each camera ray
+    double pixel_spread;
 
 public:
     /*
@@ -65,6 +69,17 @@ public:
         upper_left_corner = origin - horizontal/2 + vertical/2 - focus_dist * w;
 
         lens_radius = aperture / 2;
+
+        fov = degrees_to_radians(vertical_fov);
+        pixel_spread = 0;
+    }
+
+    /*
+        Sets the image height in pixels so rays carry a cone one pixel wide, which
+        image textures use to select a mip level.
+    */
+    void set_image_height(int image_height) {
+        pixel_spread = fov / image_height;
     }
 
     /*
@@ -84,7 +99,29 @@ public:
         // point each time since the offset origin is randomized so the ray will be at a
         // slightly different angle before and after the focus distance
         return Ray(offset_origin,
-                   (upper_left_corner + s*horizontal - (1-t)*vertical) - offset_origin);
+                   (upper_left_corner + s*horizontal - (1-t)*vertical) - offset_origin,
+                   0, pixel_spread);
+    }
+};
+
+/*
+    Placement and lens of a camera independent of the image it renders, so scenes can
+    carry a default view and render requests can override parts of it.
+*/
+struct CameraSettings {
+    Point3 look_from = Point3(0, 0, 0);
+    Point3 look_at = Point3(0, 0, -1);
+    Vec3 view_up = Vec3(0, 1, 0);
+    double vertical_fov = 60.0;
+    double aperture = 0.0;
+    double focus_dist = 10.0;
+
+    // Returns the camera for an image of the given dimensions in pixels
+    Camera make_camera(int image_width, int image_height) const {
+        Camera cam(look_from, look_at, view_up, vertical_fov,
+                   static_cast<double>(image_width) / image_height, aperture, focus_dist);
+        cam.set_image_height(image_height);
+        return cam;
     }
 };
 
@@ -1,26 +1,29 @@
 #ifndef COLOR_H
 #define COLOR_H
 
-#include "vec3.h"
 #include "utility.h"
+#include "vec3.h"
 
 #include <iostream>
 
-void write_color(std::ostream &out, Color pixel_color, int samples_per_pixel) {
-    double r = pixel_color.x();
-    double g = pixel_color.y();
-    double b = pixel_color.z();
-
+// Converts the summed samples of a pixel to gamma corrected 8-bit rgb
+void color_to_rgb8(Color pixel_color, int samples_per_pixel, unsigned char* rgb) {
     double scale = 1.0 / samples_per_pixel;
 
     // sqrt for gamma correction, raise to 1/2
-    r = sqrt(scale * r);
-    g = sqrt(scale * g);
-    b = sqrt(scale * b);
+    for (int c = 0; c < 3; ++c) {
+        double value = sqrt(scale * pixel_color[c]);
+        rgb[c] = static_cast<unsigned char>(256 * clamp(value, 0.0, 0.999));
+    }
+}
+
+void write_color(std::ostream &out, Color pixel_color, int samples_per_pixel) {
+    unsigned char rgb[3];
+    color_to_rgb8(pixel_color, samples_per_pixel, rgb);
 
-    out << static_cast<int>(256 * clamp(r, 0.0, 0.999)) << " "
-        << static_cast<int>(256 * clamp(g, 0.0, 0.999)) << " "
-        << static_cast<int>(256 * clamp(b, 0.0, 0.999)) << "\n";
+    out << static_cast<int>(rgb[0]) << " "
+        << static_cast<int>(rgb[1]) << " "
+        << static_cast<int>(rgb[2]) << "\n";
 }
 
 #endif
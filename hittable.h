@@ -11,7 +11,23 @@ struct hit_record {
     Vec3 normal;
     shared_ptr<Material> mat_ptr;
     double t;
+    // Surface coordinates of the hit point used for texture lookups
+    double u;
+    double v;
+    // Approximate width of the ray footprint at the hit point in (u, v) space
+    double uv_width;
     bool inward;
+    // Fills u and v of the final hit, set by shapes whose surface coordinates are costly
+    // so candidate hits that turn out to be occluded never compute them
+    void (*surface_uv)(hit_record& rec) = nullptr;
+
+    // Completes the surface coordinates once rec holds the closest hit
+    inline void finish_surface_uv() {
+        if (surface_uv) {
+            surface_uv(*this);
+            surface_uv = nullptr;
+        }
+    }
 
     inline void set_face_normal(const Ray& r, const Vec3& outward_normal) {
         // If ray direction is opposite to outward normal (neg dot product) then ray is
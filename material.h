@@ -2,6 +2,8 @@
 #define MATERIAL_H
 
 #include "utility.h"
+#include "onb.h"
+#include "texture.h"
 
 /*
     Abstract class representing a material type of an object. Implements functions for how a
@@ -12,6 +14,24 @@ public:
     // Given an incoming ray and hit record populate the resulting scattered ray
     virtual bool scatter(const  Ray& incoming, const hit_record& rec, Color& attenuation,
                          Ray& scattered) const = 0;
+
+    // Returns the probability density (per solid angle) of the material scattering the
+    // incoming ray into the scattered direction, 0 for materials with delta distributions
+    virtual double scattering_pdf(const Ray& incoming, const hit_record& rec,
+                                  const Ray& scattered) const {
+        return 0;
+    }
+
+    // Returns true for materials scattering the same radiance in every direction, whose
+    // reflected light is their albedo times the irradiance at the hit
+    virtual bool is_diffuse() const {
+        return false;
+    }
+
+    // Returns the albedo at the hit of diffuse materials
+    virtual Color diffuse_albedo(const hit_record& rec) const {
+        return Color(0, 0, 0);
+    }
 };
 
 /*
@@ -21,43 +41,61 @@ class Lambertian : public Material {
 public:
     // albedo = reflected_light / incident_light
     // The amount of albedo for each red, green, and blue will define the color of the material
-    Color albedo;
+    // Albedo can vary over the surface through a texture
+    shared_ptr<Texture> albedo;
 
-    Lambertian(const Color& a) : albedo(a) {}
+    Lambertian(const Color& a) : albedo(make_shared<SolidColor>(a)) {}
+
+    Lambertian(shared_ptr<Texture> a) : albedo(a) {}
 
     virtual bool scatter(const Ray& incoming, const hit_record& rec, Color& attenuation,
                          Ray& scattered) const override {
-        // Ray direction will be scattered in unit circle surface, tangent to hit point
-        auto scatter_direction = rec.normal + random_unit_vector();
-
-        // Disregard scatter direction if length close to zero
-        if (scatter_direction.near_zero()) {
-            scatter_direction = rec.normal;
-        }
+        // Importance sample the cosine term of the rendering equation by drawing the
+        // scattered direction from a cosine weighted hemisphere around the normal
+        // brdf * cos / pdf = (albedo / pi) * cos / (cos / pi) = albedo so the
+        // attenuation needs no per-sample weighting
+        Onb uvw(rec.normal);
 
         // Scattered ray will originate from hit point in scatter direction
-        scattered = Ray(rec.p, scatter_direction);
-        attenuation = albedo;
+        scattered = Ray(rec.p, uvw.local(random_cosine_direction()));
+        attenuation = albedo->value(rec.u, rec.v, rec.p, rec.uv_width);
         return true;
     }
+
+    // Lambertian scattering is distributed proportionally to cos(theta) over the hemisphere
+    virtual double scattering_pdf(const Ray& incoming, const hit_record& rec,
+                                  const Ray& scattered) const override {
+        double cosine = dot(rec.normal, unit_vector(scattered.direction()));
+        return cosine < 0 ? 0 : cosine / pi;
+    }
+
+    virtual bool is_diffuse() const override {
+        return true;
+    }
+
+    virtual Color diffuse_albedo(const hit_record& rec) const override {
+        return albedo->value(rec.u, rec.v, rec.p, rec.uv_width);
+    }
 };
 
 // Metal or totally reflective material
 class Metal : public Material {
 public:
-    Color albedo;
+    shared_ptr<Texture> albedo;
     // Fuzziness of metal, phenomena of randomized direction of reflection
     // irregular metal surfaces, capped at 1
     // Higher fuzz values correspond to larger variation from specular reflection
     double fuzz;
 
-    Metal(const Color& a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
+    Metal(const Color& a, double f) : albedo(make_shared<SolidColor>(a)), fuzz(f < 1 ? f : 1) {}
+
+    Metal(shared_ptr<Texture> a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
 
     virtual bool scatter(const Ray& incoming, const hit_record& rec, Color& attenuation,
                          Ray& scattered) const override {
         auto reflected_direction = reflect(unit_vector(incoming.direction()), rec.normal);
         scattered = Ray(rec.p, reflected_direction + fuzz*random_in_unit_sphere());
-        attenuation = albedo;
+        attenuation = albedo->value(rec.u, rec.v, rec.p, rec.uv_width);
 
         // Return final check if scattered (reflected) ray has no components opposite to normal
         return (dot(scattered.direction(), rec.normal) > 0);
@@ -117,4 +155,27 @@ private:
     }
 };
 
+// Isotropic phase function of participating media, scatters uniformly in all directions
+class Isotropic : public Material {
+public:
+    // Fraction of light kept at each scattering event inside the medium
+    shared_ptr<Texture> albedo;
+
+    Isotropic(const Color& a) : albedo(make_shared<SolidColor>(a)) {}
+
+    Isotropic(shared_ptr<Texture> a) : albedo(a) {}
+
+    virtual bool scatter(const Ray& incoming, const hit_record& rec, Color& attenuation,
+                         Ray& scattered) const override {
+        scattered = Ray(rec.p, random_unit_vector());
+        attenuation = albedo->value(rec.u, rec.v, rec.p, rec.uv_width);
+        return true;
+    }
+
+    virtual double scattering_pdf(const Ray& incoming, const hit_record& rec,
+                                  const Ray& scattered) const override {
+        return 1 / (4*pi);
+    }
+};
+
 #endif
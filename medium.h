@@ -0,0 +1,312 @@
+#ifndef MEDIUM_H
+#define MEDIUM_H
+
+#include "hittable.h"
+#include "material.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+/*
+    Participating media (fog, smoke) represented as hittables. A ray passing through a
+    medium "hits" it at a randomly sampled scattering point inside, where the medium's
+    phase function material scatters it. Rays that pass through without scattering miss
+    the medium and continue on to whatever is behind it, so media fit into ray_color like
+    any other object.
+
+    The region of a medium is given by a boundary hittable which must be convex (the ray
+    enters and exits it at most once), for example a sphere.
+*/
+
+// Finds the interval [t_enter, t_exit] where the ray is inside the boundary clipped to
+// [t_min, t_max], returns false if the ray never passes through the boundary in that range
+bool medium_interval(const Hittable& boundary, const Ray& r, double t_min, double t_max,
+                     double& t_enter, double& t_exit) {
+    hit_record rec1, rec2;
+
+    // Boundary hits are searched along the whole line so rays starting inside the
+    // medium (such as rays scattered within it) still find their entry point
+    if (!boundary.hit(r, -infinity, infinity, rec1)) return false;
+    if (!boundary.hit(r, rec1.t + 0.0001, infinity, rec2)) return false;
+
+    t_enter = std::max(rec1.t, t_min);
+    t_exit = std::min(rec2.t, t_max);
+    if (t_enter >= t_exit) return false;
+
+    t_enter = std::max(t_enter, 0.0);
+    return true;
+}
+
+// Fills the hit record of a scattering event inside a medium at t
+void set_medium_hit(const Ray& r, double t, shared_ptr<Material> phase_function,
+                    hit_record& rec) {
+    rec.t = t;
+    rec.p = r.at(t);
+
+    // Normal and face are meaningless inside a volume, set arbitrarily
+    rec.normal = Vec3(1, 0, 0);
+    rec.inward = true;
+    rec.u = 0;
+    rec.v = 0;
+    rec.uv_width = 0;
+    rec.surface_uv = nullptr;
+    rec.mat_ptr = phase_function;
+}
+
+/*
+    Medium of constant density. The distance a ray travels before scattering is
+    exponentially distributed, so it is sampled in closed form.
+*/
+class ConstantMedium : public Hittable {
+public:
+    shared_ptr<Hittable> boundary;
+    shared_ptr<Material> phase_function;
+    // Scattering events per unit distance
+    double density;
+
+    ConstantMedium(shared_ptr<Hittable> b, double d, const Color& c)
+        : boundary(b), phase_function(make_shared<Isotropic>(c)), density(d) {}
+
+    ConstantMedium(shared_ptr<Hittable> b, double d, shared_ptr<Texture> a)
+        : boundary(b), phase_function(make_shared<Isotropic>(a)), density(d) {}
+
+    virtual bool hit(const Ray& r, double t_min, double t_max, hit_record& rec) const override {
+        double t_enter, t_exit;
+        if (!medium_interval(*boundary, r, t_min, t_max, t_enter, t_exit)) return false;
+
+        double ray_length = r.direction().length();
+        double distance_inside = (t_exit - t_enter) * ray_length;
+        double hit_distance = -std::log(1.0 - random_double()) / density;
+
+        // Ray passes through the medium without scattering
+        if (hit_distance > distance_inside) return false;
+
+        set_medium_hit(r, t_enter + hit_distance / ray_length, phase_function, rec);
+        return true;
+    }
+};
+
+/*
+    Density values on a regular voxel grid spanning an axis aligned box, sampled with
+    trilinear interpolation and zero outside the box.
+
+    Alongside the voxels a coarse majorant grid stores the maximum density each block of
+    block_size^3 voxels can take, so tracking can step over empty blocks in one go and use
+    a tight bound in sparse ones.
+*/
+class DensityGrid {
+public:
+    static const int block_size = 8;
+
+    Point3 box_min;
+    Point3 box_max;
+    int res[3];
+    std::vector<double> voxels;
+
+    // Size of one voxel and one majorant block in world units
+    Vec3 voxel_size;
+    Vec3 block_extent;
+    int blocks[3];
+    std::vector<double> majorants;
+
+    /*
+        Builds the grid by evaluating a density function at every voxel center.
+
+        @param min Lower corner of the grid box in world frame
+        @param max Upper corner of the grid box in world frame
+        @param nx, ny, nz Voxel resolution along each axis
+        @param density Density at a point in world frame
+    */
+    DensityGrid(const Point3& min, const Point3& max, int nx, int ny, int nz,
+                std::function<double(const Point3&)> density)
+        : box_min(min), box_max(max), res{nx, ny, nz} {
+        for (int a = 0; a < 3; ++a) {
+            voxel_size[a] = (box_max[a] - box_min[a]) / res[a];
+            block_extent[a] = voxel_size[a] * block_size;
+            blocks[a] = (res[a] + block_size - 1) / block_size;
+        }
+
+        voxels.resize(static_cast<size_t>(nx) * ny * nz);
+        for (int z = 0; z < nz; ++z) {
+            for (int y = 0; y < ny; ++y) {
+                for (int x = 0; x < nx; ++x) {
+                    Point3 p = box_min + Vec3((x + 0.5) * voxel_size[0], (y + 0.5) * voxel_size[1],
+                                              (z + 0.5) * voxel_size[2]);
+                    voxels[index(x, y, z)] = std::max(density(p), 0.0);
+                }
+            }
+        }
+
+        build_majorants();
+    }
+
+    size_t index(int x, int y, int z) const {
+        return (static_cast<size_t>(z) * res[1] + y) * res[0] + x;
+    }
+
+    // Trilinearly interpolated density at a point in world frame
+    double density(const Point3& p) const {
+        int i0[3];
+        double f[3];
+        for (int a = 0; a < 3; ++a) {
+            // Voxel values sit at voxel centers
+            double g = (p[a] - box_min[a]) / voxel_size[a] - 0.5;
+            if (g < -1.0 || g > res[a]) return 0;
+            double g_floor = std::floor(g);
+            i0[a] = static_cast<int>(g_floor);
+            f[a] = g - g_floor;
+        }
+
+        double result = 0;
+        for (int k = 0; k < 2; ++k) {
+            int z = std::min(std::max(i0[2] + k, 0), res[2] - 1);
+            double wz = k ? f[2] : 1 - f[2];
+            for (int j = 0; j < 2; ++j) {
+                int y = std::min(std::max(i0[1] + j, 0), res[1] - 1);
+                double wy = j ? f[1] : 1 - f[1];
+                for (int i = 0; i < 2; ++i) {
+                    int x = std::min(std::max(i0[0] + i, 0), res[0] - 1);
+                    double wx = i ? f[0] : 1 - f[0];
+                    result += wx * wy * wz * voxels[index(x, y, z)];
+                }
+            }
+        }
+        return result;
+    }
+
+    double majorant(int bx, int by, int bz) const {
+        return majorants[(static_cast<size_t>(bz) * blocks[1] + by) * blocks[0] + bx];
+    }
+
+private:
+    // Interpolation inside a block also reads the voxels just past its edges, so each
+    // majorant is the maximum over the block grown by one voxel on every side
+    void build_majorants() {
+        majorants.assign(static_cast<size_t>(blocks[0]) * blocks[1] * blocks[2], 0.0);
+        for (int bz = 0; bz < blocks[2]; ++bz) {
+            for (int by = 0; by < blocks[1]; ++by) {
+                for (int bx = 0; bx < blocks[0]; ++bx) {
+                    double m = 0;
+                    for (int z = std::max(bz*block_size - 1, 0);
+                         z < std::min((bz + 1)*block_size + 1, res[2]); ++z) {
+                        for (int y = std::max(by*block_size - 1, 0);
+                             y < std::min((by + 1)*block_size + 1, res[1]); ++y) {
+                            for (int x = std::max(bx*block_size - 1, 0);
+                                 x < std::min((bx + 1)*block_size + 1, res[0]); ++x) {
+                                m = std::max(m, voxels[index(x, y, z)]);
+                            }
+                        }
+                    }
+                    majorants[(static_cast<size_t>(bz) * blocks[1] + by) * blocks[0] + bx] = m;
+                }
+            }
+        }
+    }
+};
+
+/*
+    Medium with density varying over a DensityGrid, sampled with delta (Woodcock) tracking.
+
+    The ray walks the majorant grid block by block (3D DDA). Empty blocks are skipped
+    outright. Within a block tentative collisions are sampled against the block majorant
+    and accepted with probability density / majorant, otherwise the ray continues. This is
+    unbiased, and since each block's majorant is tight the number of rejected collisions
+    stays low, keeping the cost close to that of a constant medium.
+*/
+class HeterogeneousMedium : public Hittable {
+public:
+    shared_ptr<Hittable> boundary;
+    shared_ptr<DensityGrid> grid;
+    shared_ptr<Material> phase_function;
+
+    HeterogeneousMedium(shared_ptr<Hittable> b, shared_ptr<DensityGrid> g, const Color& c)
+        : boundary(b), grid(g), phase_function(make_shared<Isotropic>(c)) {}
+
+    HeterogeneousMedium(shared_ptr<Hittable> b, shared_ptr<DensityGrid> g,
+                        shared_ptr<Texture> a)
+        : boundary(b), grid(g), phase_function(make_shared<Isotropic>(a)) {}
+
+    virtual bool hit(const Ray& r, double t_min, double t_max, hit_record& rec) const override {
+        double t_enter, t_exit;
+        if (!medium_interval(*boundary, r, t_min, t_max, t_enter, t_exit)) return false;
+        if (!clip_to_grid(r, t_enter, t_exit)) return false;
+
+        const Vec3& dir = r.direction();
+        double ray_length = dir.length();
+
+        // Set up the DDA over majorant blocks from the entry point
+        Point3 p = r.at(t_enter);
+        int block[3], step[3];
+        double t_next[3], t_delta[3];
+        for (int a = 0; a < 3; ++a) {
+            double x = (p[a] - grid->box_min[a]) / grid->block_extent[a];
+            block[a] = std::min(std::max(static_cast<int>(std::floor(x)), 0), grid->blocks[a] - 1);
+
+            double block_start = grid->box_min[a] + block[a] * grid->block_extent[a];
+            if (dir[a] > 0) {
+                step[a] = 1;
+                t_next[a] = t_enter + (block_start + grid->block_extent[a] - p[a]) / dir[a];
+                t_delta[a] = grid->block_extent[a] / dir[a];
+            } else if (dir[a] < 0) {
+                step[a] = -1;
+                t_next[a] = t_enter + (block_start - p[a]) / dir[a];
+                t_delta[a] = -grid->block_extent[a] / dir[a];
+            } else {
+                step[a] = 0;
+                t_next[a] = infinity;
+                t_delta[a] = infinity;
+            }
+        }
+
+        double t = t_enter;
+        while (t < t_exit) {
+            // Axis whose block boundary the ray crosses first
+            int a = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2)
+                                          : (t_next[1] < t_next[2] ? 1 : 2);
+            double t_block_exit = std::min(t_next[a], t_exit);
+
+            double majorant = grid->majorant(block[0], block[1], block[2]);
+            if (majorant > 0) {
+                // Free flights are exponential so sampling can restart at every block
+                // boundary with the next block's majorant
+                while (true) {
+                    t += -std::log(1.0 - random_double()) / (majorant * ray_length);
+                    if (t >= t_block_exit) break;
+
+                    // Real collision with probability density / majorant, otherwise
+                    // a null collision and the ray carries on
+                    if (random_double() * majorant < grid->density(r.at(t))) {
+                        set_medium_hit(r, t, phase_function, rec);
+                        return true;
+                    }
+                }
+            }
+
+            t = t_block_exit;
+            block[a] += step[a];
+            if (block[a] < 0 || block[a] >= grid->blocks[a]) break;
+            t_next[a] += t_delta[a];
+        }
+
+        return false;
+    }
+
+private:
+    // Clips [t_enter, t_exit] to the grid box (slab test), false if nothing is left
+    bool clip_to_grid(const Ray& r, double& t_enter, double& t_exit) const {
+        for (int a = 0; a < 3; ++a) {
+            double inv_d = 1.0 / r.direction()[a];
+            double t0 = (grid->box_min[a] - r.origin()[a]) * inv_d;
+            double t1 = (grid->box_max[a] - r.origin()[a]) * inv_d;
+            if (inv_d < 0) std::swap(t0, t1);
+            t_enter = std::max(t_enter, t0);
+            t_exit = std::min(t_exit, t1);
+            if (t_exit <= t_enter) return false;
+        }
+        return true;
+    }
+};
+
+#endif
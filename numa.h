@@ -0,0 +1,101 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/*
+    NUMA topology discovery and thread pinning. Topology is read from sysfs on Linux and
+    restricted to the cpus the process may run on, since sysfs lists every cpu of a node
+    even inside a smaller cpuset. Elsewhere, or when sysfs has no node information, the
+    machine is treated as a single node holding every cpu and pinning is a no-op.
+*/
+
+// Parses a sysfs cpu list such as "0-3,8-11" into cpu ids
+std::vector<int> parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    std::istringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        if (range.empty() || range == "\n") continue;
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// Returns the cpu ids of every NUMA node that has cpus, indexed by node
+std::vector<std::vector<int>> numa_node_cpus() {
+    std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+    cpu_set_t allowed;
+    bool restricted = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    // Node ids can have gaps (offline or memory only nodes), so probe a generous range
+    for (int node = 0; node < 256; ++node) {
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!in) continue;
+        std::string list;
+        std::getline(in, list);
+        std::vector<int> cpus;
+        for (int cpu : parse_cpu_list(list)) {
+            if (!restricted || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty()) nodes.push_back(cpus);
+    }
+#endif
+    if (nodes.empty()) {
+        std::vector<int> cpus;
+        int count = std::max(1u, std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < count; ++cpu) cpus.push_back(cpu);
+        nodes.push_back(cpus);
+    }
+    return nodes;
+}
+
+/*
+    Regroups the cpus of all nodes into count nodes of consecutive cpus. Lets the NUMA
+    scheduling and replication paths run on machines with fewer real nodes, for testing.
+    Cpus are shared round robin when there are fewer cpus than nodes.
+*/
+std::vector<std::vector<int>> split_node_cpus(const std::vector<std::vector<int>>& nodes,
+                                              int count) {
+    std::vector<int> cpus;
+    for (const auto& node : nodes) cpus.insert(cpus.end(), node.begin(), node.end());
+
+    std::vector<std::vector<int>> split(count);
+    int total = static_cast<int>(cpus.size());
+    for (int node = 0; node < count; ++node) {
+        int first = node * total / count;
+        int last = (node + 1) * total / count;
+        if (first == last) split[node].push_back(cpus[node % total]);
+        for (int i = first; i < last; ++i) split[node].push_back(cpus[i]);
+    }
+    return split;
+}
+
+// Restricts the calling thread to the given cpus, returns false if not supported
+bool pin_current_thread(const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+#endif
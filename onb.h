@@ -0,0 +1,39 @@
+#ifndef ONB_H
+#define ONB_H
+
+#include "vec3.h"
+
+#include <cmath>
+
+/*
+    Class representing an orthonormal basis (u, v, w) built around a given w direction.
+    Used to transform directions sampled in a local z-up frame into world space, for
+    example a cosine weighted hemisphere sample around a surface normal.
+*/
+
+class Onb {
+public:
+    Vec3 u, v, w;
+
+    // Builds the basis from a unit length w vector
+    // Uses the branchless construction from Duff et al. "Building an Orthonormal Basis,
+    // Revisited" so no special case is needed when w is near an axis
+    Onb(const Vec3& n) : w(n) {
+        double sign = std::copysign(1.0, n.z());
+        double a = -1.0 / (sign + n.z());
+        double b = n.x() * n.y() * a;
+        u = Vec3(1.0 + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+        v = Vec3(b, sign + n.y() * n.y() * a, -n.y());
+    }
+
+    // Returns the world space vector of local coordinates (a, b, c) in the basis
+    Vec3 local(double a, double b, double c) const {
+        return a*u + b*v + c*w;
+    }
+
+    Vec3 local(const Vec3& a) const {
+        return a.x()*u + a.y()*v + a.z()*w;
+    }
+};
+
+#endif
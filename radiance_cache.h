@@ -0,0 +1,166 @@
+#ifndef RADIANCE_CACHE_H
+#define RADIANCE_CACHE_H
+
+#include "utility.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+/*
+    Spatial hash grid caching the irradiance arriving at diffuse surfaces.
+
+    The light a Lambertian surface reflects is its albedo times the irradiance arriving
+    at it, and irradiance changes slowly over a surface. Paths that already took one
+    diffuse bounce look up the cell around their next diffuse hit instead of tracing the
+    rest of the path, and shade it with the albedo at the hit itself, so textures keep
+    their detail in indirect light. Cells are keyed by position and by the dominant axis
+    of the surface normal so the two sides of a thin object do not share a cell.
+
+    Entries are built by the render threads themselves while rendering. Each cell
+    averages a fixed number of path traced estimates and is frozen once it has them, only
+    frozen cells are used. The table is a fixed size open addressing hash table whose
+    slots are claimed, filled and read with atomics, so neither lookups nor additions
+    take a lock. Cells that do not fit once the table is full are simply not cached.
+
+    The result is biased (irradiance is blurred across a cell), so it is an opt-in
+    quality trade off next to the unbiased path.
+*/
+class RadianceCache {
+public:
+    /*
+        @param cell_size Edge length of a grid cell in world units
+        @param samples Path traced estimates averaged by a cell before lookups use it
+        @param max_cells Cells the table can hold, memory is about 80 bytes per cell
+    */
+    RadianceCache(double cell_size, int samples = 16, size_t max_cells = 1 << 17)
+        : inv_cell_size(1.0 / cell_size), samples(samples), hits(0), misses(0), cells(0),
+          dropped(0) {
+        // Keep the table at most half full so probe sequences stay short
+        capacity = 1;
+        while (capacity < 2 * max_cells) capacity *= 2;
+        max_entries = max_cells;
+        slots.reset(new Slot[capacity]);
+    }
+
+    RadianceCache(const RadianceCache&) = delete;
+    RadianceCache& operator=(const RadianceCache&) = delete;
+
+    // Returns true and sets irradiance if the cell of p and normal is frozen
+    bool lookup(const Point3& p, const Vec3& normal, Color& irradiance) {
+        uint64_t key;
+        Slot* slot = cell_key(p, normal, key) ? find(key, false) : nullptr;
+        // Acquire pairs with the release of the last estimate, making every sum visible
+        if (slot && slot->added.load(std::memory_order_acquire) >= samples) {
+            irradiance = Color(slot->sum[0].load(std::memory_order_relaxed),
+                               slot->sum[1].load(std::memory_order_relaxed),
+                               slot->sum[2].load(std::memory_order_relaxed)) / samples;
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Adds a path traced estimate of the irradiance arriving at p
+    void add(const Point3& p, const Vec3& normal, const Color& irradiance) {
+        uint64_t key;
+        Slot* slot = cell_key(p, normal, key) ? find(key, true) : nullptr;
+        if (!slot) return;
+
+        // Only the first samples estimates are kept, the cell is frozen after them
+        if (slot->claimed.fetch_add(1, std::memory_order_relaxed) >= samples) return;
+        for (int a = 0; a < 3; ++a) {
+            double sum = slot->sum[a].load(std::memory_order_relaxed);
+            while (!slot->sum[a].compare_exchange_weak(sum, sum + irradiance[a],
+                                                       std::memory_order_relaxed)) {}
+        }
+        slot->added.fetch_add(1, std::memory_order_release);
+    }
+
+    // Writes lookup hit rate and size of the cache
+    void print_stats(std::ostream& out) const {
+        uint64_t h = hits.load(), m = misses.load();
+        double hit_rate = (h + m) > 0 ? 100.0 * h / (h + m) : 0.0;
+        out << "Radiance cache: " << h << " hits, " << m << " misses (" << hit_rate
+            << "% hit rate), " << cells.load() << " cells";
+        if (dropped.load() > 0) out << ", " << dropped.load() << " estimates dropped, table full";
+        out << "\n";
+    }
+
+private:
+    // Cell coordinates must fit the 20 bits each gets in a key
+    static const int64_t coordinate_limit = 1 << 19;
+
+    struct Slot {
+        // Packed cell key, 0 while the slot is free
+        std::atomic<uint64_t> key;
+        std::atomic<int> claimed;
+        std::atomic<int> added;
+        std::atomic<double> sum[3];
+
+        Slot() : key(0), claimed(0), added(0) {
+            for (auto& s : sum) s.store(0.0);
+        }
+    };
+
+    double inv_cell_size;
+    int samples;
+    size_t capacity;
+    size_t max_entries;
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> cells;
+    std::atomic<uint64_t> dropped;
+
+    // Packs the cell of p and normal into key, returns false if p is outside the grid
+    bool cell_key(const Point3& p, const Vec3& normal, uint64_t& key) const {
+        key = uint64_t(1) << 63;
+        for (int a = 0; a < 3; ++a) {
+            double cell = std::floor(p[a] * inv_cell_size);
+            if (!(fabs(cell) < coordinate_limit)) return false;
+            uint64_t biased = static_cast<uint64_t>(static_cast<int64_t>(cell) + coordinate_limit);
+            key |= biased << (a * 20);
+        }
+
+        int axis = 0;
+        for (int a = 1; a < 3; ++a) {
+            if (fabs(normal[a]) > fabs(normal[axis])) axis = a;
+        }
+        key |= static_cast<uint64_t>(axis * 2 + (normal[axis] < 0 ? 1 : 0)) << 60;
+        return true;
+    }
+
+    // Returns the slot of key, claiming a free one if insert is set and there is room
+    Slot* find(uint64_t key, bool insert) {
+        // Finalizer of splitmix64 spreads neighboring cells over the table
+        uint64_t h = key;
+        h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+        h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+        h ^= h >> 31;
+
+        for (size_t i = h & (capacity - 1); ; i = (i + 1) & (capacity - 1)) {
+            uint64_t current = slots[i].key.load(std::memory_order_acquire);
+            if (current == key) return &slots[i];
+            if (current != 0) continue;
+            if (!insert) return nullptr;
+
+            if (cells.fetch_add(1, std::memory_order_relaxed) >= max_entries) {
+                cells.fetch_sub(1, std::memory_order_relaxed);
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            if (slots[i].key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+                return &slots[i];
+            }
+            // Another thread claimed the slot first, it may have claimed it for key
+            cells.fetch_sub(1, std::memory_order_relaxed);
+            if (current == key) return &slots[i];
+        }
+    }
+};
+
+#endif
@@ -7,10 +7,18 @@ class Ray {
 public:
     Point3 orig;
     Vec3 dir;
+    // Ray cone used to estimate the footprint of the ray on surfaces it hits, used for
+    // texture filtering. Width of the cone at the origin and its spread angle in radians
+    double width;
+    double spread;
 
-    Ray() {}
+    Ray() : width(0), spread(0) {}
 
-    Ray(const Point3& origin, const Vec3& direction) : orig(origin), dir(direction) {}
+    Ray(const Point3& origin, const Vec3& direction)
+        : orig(origin), dir(direction), width(0), spread(0) {}
+
+    Ray(const Point3& origin, const Vec3& direction, double w, double s)
+        : orig(origin), dir(direction), width(w), spread(s) {}
 
     ~Ray() {}
 
@@ -22,6 +30,11 @@ public:
     Point3 at(double t) const {
         return (orig + t*dir);
     }
+
+    // Returns the width of the ray cone at variable t
+    double width_at(double t) const {
+        return width + spread * t * dir.length();
+    }
 };
 
 #endif
@@ -0,0 +1,112 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "utility.h"
+
+#include "camera.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "radiance_cache.h"
+
+/*
+    Core rendering routines shared by the one-shot renderer and the render daemon.
+*/
+
+// Return color of pixel based on ray and scene
+// With a radiance cache, diffuse hits of paths that already bounced off a diffuse surface
+// are shaded from the cached irradiance when available, otherwise the irradiance traced
+// for them is added to the cache
+Color ray_color(const Ray& r, const Hittable& scene, int depth,
+                RadianceCache* radiance_cache = nullptr, bool after_diffuse = false) {
+    if (depth <= 0) {
+        return Color(0, 0, 0);
+    }
+
+    hit_record rec;
+    if (scene.hit(r, 0.001, infinity, rec)) {
+        rec.finish_surface_uv();
+        bool diffuse = rec.mat_ptr->is_diffuse();
+        bool cacheable = radiance_cache && after_diffuse && diffuse;
+
+        Color irradiance;
+        if (cacheable && radiance_cache->lookup(rec.p, rec.normal, irradiance)) {
+            return rec.mat_ptr->diffuse_albedo(rec) * irradiance;
+        }
+
+        Ray scattered;
+        Color attenuation;
+        if (rec.mat_ptr->scatter(r, rec, attenuation, scattered)) {
+            // Carry the ray cone over the bounce so textures seen in reflections are
+            // filtered by the footprint of the whole path so far
+            scattered.width = r.width_at(rec.t);
+            scattered.spread = r.spread;
+            Color incoming = ray_color(scattered, scene, depth-1, radiance_cache,
+                                       after_diffuse || diffuse);
+            // Diffuse scattering is cosine sampled, so the incoming radiance of the
+            // scattered ray is an estimate of the irradiance (over pi) at the hit
+            if (cacheable) {
+                radiance_cache->add(rec.p, rec.normal, incoming);
+            }
+            return attenuation * incoming;
+        }
+        return Color(0, 0, 0);
+    }
+
+    // If didn't hit anything in scene then just color blue to white gradient
+    Vec3 unit_direction = unit_vector(r.direction());
+    double t = 0.5 * (unit_direction.y() + 1.0);
+    return (1.0 - t) * Color(1.0, 1.0, 1.0) + (t * Color(0.5, 0.7, 1.0));
+}
+
+// Image dimensions and sampling settings of a render
+struct RenderSettings {
+    int image_width = 400;
+    int image_height = 225;
+    int samples_per_pixel = 100;
+    int max_depth = 40;
+    // Use a radiance cache for diffuse indirect lighting instead of the unbiased path
+    bool radiance_cache = false;
+    // Edge length of radiance cache cells in world units
+    double radiance_cache_cell = 0.1;
+    // Path traced irradiance estimates averaged by a cell before it is used
+    int radiance_cache_samples = 16;
+};
+
+/*
+    Returns the summed color of all samples of pixel (i, j), where j counts rows from the
+    bottom of the image. Divide by the samples per pixel to get the pixel color.
+*/
+Color render_pixel(const Hittable& scene, const Camera& cam, const RenderSettings& settings,
+                   int i, int j, RadianceCache* radiance_cache = nullptr) {
+    Color pixel_color = Color(0, 0, 0);
+
+    // For each pixel shoot multiple rays which vary randomly by max one pixel
+    // then aggregate the pixel colors of all sampls and divide by number of samples
+    // to get antialiasing in pixel coloring, results in overall more uniform shading
+    for (int k=0 ; k<settings.samples_per_pixel ; ++k) {
+        double u = (i + random_double()) / (settings.image_width - 1);
+        double v = (j + random_double()) / (settings.image_height - 1);
+        Ray r = cam.get_ray(u, v);
+        pixel_color += ray_color(r, scene, settings.max_depth, radiance_cache);
+    }
+    return pixel_color;
+}
+
+/*
+    Renders the pixels in columns [x0, x1) and rows [y0, y1) of the image, rows counted
+    from the top. Summed sample colors are written to pixels in row major order with the
+    given row stride. The radiance cache, if any, is shared with other tiles of the render.
+*/
+void render_tile(const Hittable& scene, const Camera& cam, const RenderSettings& settings,
+                 int x0, int y0, int x1, int y1, Color* pixels, int stride,
+                 RadianceCache* radiance_cache = nullptr) {
+    for (int y=y0 ; y<y1 ; ++y) {
+        int j = settings.image_height - 1 - y;
+        for (int x=x0 ; x<x1 ; ++x) {
+            pixels[(y - y0) * stride + (x - x0)] = render_pixel(scene, cam, settings, x, j,
+                                                                   radiance_cache);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,120 @@
+#include "tile_output.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+    Command line client of the render daemon. Sends a single request and prints the reply
+    along with the round trip time seen by the client. The convert command runs locally and
+    turns a streamed tiled image (.rtt) into a PPM image. Relative out= paths are resolved
+    against the client's working directory before the request is sent.
+
+    Examples:
+        render_client render scene=random out=preview.ppm width=320 height=180 spp=16
+        render_client render scene=random out=poster.rtt width=20000 height=11250 spp=64
+        render_client convert poster.rtt poster.ppm
+        render_client --socket /tmp/other.sock stats
+*/
+
+const char* default_socket_path = "/tmp/raytracer.sock";
+
+// Converts a tiled image to PPM without involving the daemon
+int convert(const std::string& in_path, const std::string& out_path) {
+    std::ofstream out(out_path);
+    if (!out) {
+        std::cerr << "Cannot write " << out_path << "\n";
+        return 1;
+    }
+    try {
+        tiled_image_to_ppm(in_path, out);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 4 && std::string(argv[1]) == "convert") {
+        return convert(argv[2], argv[3]);
+    }
+
+    std::string path = default_socket_path;
+    std::string request;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            path = argv[++i];
+            continue;
+        }
+        // The daemon runs in its own working directory, so resolve output paths here
+        if (arg.compare(0, 4, "out=") == 0 && arg.size() > 4 && arg[4] != '/') {
+            char cwd[4096];
+            if (getcwd(cwd, sizeof(cwd)) == nullptr) {
+                std::cerr << "Cannot resolve " << arg << ": " << std::strerror(errno) << "\n";
+                return 1;
+            }
+            arg = "out=" + std::string(cwd) + "/" + arg.substr(4);
+        }
+        if (!request.empty()) request += " ";
+        request += arg;
+    }
+    if (request.empty()) {
+        std::cerr << "usage: render_client [--socket path] render scene=<name> out=<path> "
+                  << "[key=value ...]\n"
+                  << "       render_client [--socket path] stats\n"
+                  << "       render_client convert <in.rtt> <out.ppm>\n";
+        return 1;
+    }
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << path << "\n";
+        return 1;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    auto start = std::chrono::steady_clock::now();
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 || connect(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        std::cerr << "Cannot connect to render daemon at " << path << ": "
+                  << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    request += "\n";
+    if (write(server, request.data(), request.size()) < 0) {
+        std::cerr << "Failed to send request: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    // Reply is a single line sent once the request is finished
+    std::string reply;
+    char chunk[4096];
+    ssize_t n;
+    while (reply.find('\n') == std::string::npos && (n = read(server, chunk, sizeof(chunk))) > 0) {
+        reply.append(chunk, n);
+    }
+    close(server);
+
+    double round_trip_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    reply = reply.substr(0, reply.find('\n'));
+    std::cout << reply << "\n";
+    std::cerr << "round trip " << round_trip_ms << " ms\n";
+
+    return reply.compare(0, 3, "ok ") == 0 ? 0 : 1;
+}
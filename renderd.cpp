@@ -0,0 +1,576 @@
+#include "utility.h"
+
+#include "color.h"
+#include "render.h"
+#include "scene_cache.h"
+#include "scenes.h"
+#include "numa.h"
+#include "thread_pool.h"
+#include "tile_output.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+    Render daemon. Builds the requested scenes once at startup and keeps them resident,
+    then serves render requests from a local Unix socket. Every request is split into
+    tiles which run on one shared thread pool ordered by request priority, so many short
+    preview renders pay neither process startup nor scene construction.
+
+    Output paths ending in .rtt stream each finished tile to a tiled image file and free it
+    right away (see tile_output.h), so memory stays bounded for very large images. Any
+    other path is written as a PPM image from a full framebuffer once the render is done.
+
+    Protocol: one request per line, answered with one line once it is finished.
+        render scene=<name> out=<path> [width=400] [height=225] [spp=100] [depth=40]
+               [priority=0] [look_from=x,y,z] [look_at=x,y,z] [up=x,y,z] [vfov=deg]
+               [aperture=a] [focus=d] [cache=0|1] [cache_cell=0.1] [cache_samples=16]
+            -> ok job=<id> queue_ms=<t> render_ms=<t> write_ms=<t> total_ms=<t>
+        stats
+            -> ok jobs=<n> mean_total_ms=<t> max_total_ms=<t> ... texture_hit_rate=<%>
+               texture_resident_kib=<n>
+    Failures are answered with "error <message>". Output paths must be absolute since the
+    daemon's working directory is unrelated to the client's. Camera fields not given in a
+    request come from the scene's default camera. cache=1 renders diffuse indirect lighting
+    from an irradiance cache built by the job itself (see radiance_cache.h), faster but
+    biased, cache=0 keeps the unbiased path.
+*/
+
+using Clock = std::chrono::steady_clock;
+
+const char* default_socket_path = "/tmp/raytracer.sock";
+
+// Socket path removed again when the daemon is interrupted
+char socket_path[sizeof(sockaddr_un::sun_path)];
+
+// A scene kept resident by the daemon
+struct ResidentScene {
+    shared_ptr<Hittable> world;
+    CameraSettings camera;
+    // Copies of world local to each NUMA node, empty unless running NUMA aware
+    std::vector<shared_ptr<Hittable>> replicas;
+
+    // Returns the copy of the scene that threads of the given node should trace
+    const Hittable& world_on(int node) const {
+        return node < static_cast<int>(replicas.size()) ? *replicas[node] : *world;
+    }
+};
+
+/*
+    Gives every scene a replica per NUMA node. Each replica is made by a thread pinned to
+    its node so first touch allocates it in that node's memory. Only scenes mapped from the
+    scene cache are flat enough to copy, other scenes are shared by all nodes as before
+    and reported as such.
+*/
+void replicate_per_node(std::map<std::string, ResidentScene>& scenes,
+                        const std::vector<std::vector<int>>& node_cpus) {
+    for (auto& entry : scenes) {
+        entry.second.replicas.assign(node_cpus.size(), entry.second.world);
+    }
+
+    for (const auto& entry : scenes) {
+        if (!std::dynamic_pointer_cast<MappedScene>(entry.second.world)) {
+            std::cerr << "Scene " << entry.first << " is not mapped from the scene cache (see "
+                      << "--cache-dir), all NUMA nodes share one copy\n";
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t node = 0; node < node_cpus.size(); ++node) {
+        threads.emplace_back([&scenes, &node_cpus, node]() {
+            if (!pin_current_thread(node_cpus[node])) {
+                std::ostringstream message;
+                message << "Cannot pin to NUMA node " << node << ", its scene replicas may "
+                        << "be allocated on another node\n";
+                std::cerr << message.str();
+            }
+            for (auto& entry : scenes) {
+                auto mapped = std::dynamic_pointer_cast<MappedScene>(entry.second.world);
+                if (mapped) entry.second.replicas[node] = mapped->replicate();
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+}
+
+double elapsed_ms(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// A render request in flight
+struct RenderJob {
+    int id;
+    const ResidentScene* scene;
+    Camera cam;
+    RenderSettings settings;
+    int priority;
+    std::string out_path;
+
+    // Summed sample colors of every pixel, rows from the top
+    // Left empty when tiles stream straight to a tiled image writer instead
+    std::vector<Color> pixels;
+    TiledImageWriter* writer = nullptr;
+    // Shared by every tile of the job, null unless the request enabled it
+    RadianceCache* radiance_cache = nullptr;
+    std::atomic<int> tiles_remaining;
+
+    Clock::time_point submitted;
+    std::atomic<bool> started;
+    Clock::time_point render_start;
+    Clock::time_point render_end;
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool done = false;
+    // Set by the first tile that threw, later tiles of the job are skipped
+    std::atomic<bool> failed;
+    std::string error;
+
+    RenderJob(const Camera& c) : cam(c), tiles_remaining(0), started(false), failed(false) {}
+};
+
+class RenderDaemon {
+public:
+    // Workers are pinned per NUMA node when node_cpus is given, unpinned when it is empty
+    RenderDaemon(std::map<std::string, ResidentScene> s, shared_ptr<TextureCache> textures,
+                 int threads, int tile, const std::vector<std::vector<int>>& node_cpus)
+        : scenes(std::move(s)), texture_cache(textures),
+          pool(node_cpus.empty() ? new ThreadPool(threads) : new ThreadPool(node_cpus, threads)),
+          tile_size(tile), next_job_id(0),
+          jobs_completed(0), total_ms_sum(0), total_ms_max(0), render_ms_sum(0) {}
+
+    // Handles one request line and returns the reply line
+    std::string handle(const std::string& line) {
+        std::istringstream tokens(line);
+        std::string command;
+        tokens >> command;
+
+        try {
+            if (command == "render") return render(tokens);
+            if (command == "stats") return stats();
+            throw std::runtime_error("unknown command '" + command + "'");
+        } catch (const std::exception& e) {
+            return std::string("error ") + e.what();
+        }
+    }
+
+private:
+    std::map<std::string, ResidentScene> scenes;
+    // Tile cache of the image textures of every resident scene
+    shared_ptr<TextureCache> texture_cache;
+    std::unique_ptr<ThreadPool> pool;
+    int tile_size;
+
+    std::atomic<int> next_job_id;
+    std::mutex metrics_mutex;
+    int jobs_completed;
+    double total_ms_sum;
+    double total_ms_max;
+    double render_ms_sum;
+
+    static Vec3 parse_vec3(const std::string& value) {
+        Vec3 v;
+        std::istringstream in(value);
+        char comma;
+        if (!(in >> v[0] >> comma >> v[1] >> comma >> v[2])) {
+            throw std::runtime_error("expected x,y,z but got '" + value + "'");
+        }
+        return v;
+    }
+
+    std::string render(std::istream& tokens) {
+        std::map<std::string, std::string> fields;
+        std::string token;
+        while (tokens >> token) {
+            size_t eq = token.find('=');
+            if (eq == std::string::npos) throw std::runtime_error("expected key=value: " + token);
+            fields[token.substr(0, eq)] = token.substr(eq + 1);
+        }
+
+        auto scene_it = scenes.find(fields["scene"]);
+        if (scene_it == scenes.end()) {
+            throw std::runtime_error("scene '" + fields["scene"] + "' is not loaded");
+        }
+        if (fields["out"].empty()) throw std::runtime_error("missing out=<path>");
+        if (fields["out"][0] != '/') {
+            throw std::runtime_error("out=<path> must be absolute, got " + fields["out"]);
+        }
+
+        RenderSettings settings;
+        CameraSettings camera = scene_it->second.camera;
+        int priority = 0;
+        for (const auto& field : fields) {
+            const std::string& key = field.first;
+            const std::string& value = field.second;
+            try {
+                if (key == "width") settings.image_width = std::stoi(value);
+                else if (key == "height") settings.image_height = std::stoi(value);
+                else if (key == "spp") settings.samples_per_pixel = std::stoi(value);
+                else if (key == "depth") settings.max_depth = std::stoi(value);
+                else if (key == "priority") priority = std::stoi(value);
+                else if (key == "look_from") camera.look_from = parse_vec3(value);
+                else if (key == "look_at") camera.look_at = parse_vec3(value);
+                else if (key == "up") camera.view_up = parse_vec3(value);
+                else if (key == "vfov") camera.vertical_fov = std::stod(value);
+                else if (key == "aperture") camera.aperture = std::stod(value);
+                else if (key == "focus") camera.focus_dist = std::stod(value);
+                else if (key == "cache") settings.radiance_cache = std::stoi(value) != 0;
+                else if (key == "cache_cell") settings.radiance_cache_cell = std::stod(value);
+                else if (key == "cache_samples") settings.radiance_cache_samples = std::stoi(value);
+                else if (key != "scene" && key != "out") {
+                    throw std::runtime_error("unknown field '" + key + "'");
+                }
+            } catch (const std::logic_error&) {
+                // std::stoi and std::stod report malformed numbers as logic errors
+                throw std::runtime_error("bad value for '" + key + "': " + value);
+            }
+        }
+        if (settings.image_width < 2 || settings.image_height < 2 ||
+            settings.samples_per_pixel < 1 || settings.max_depth < 1) {
+            throw std::runtime_error("image must be at least 2x2 with spp and depth >= 1");
+        }
+        if (settings.radiance_cache_cell <= 0 || settings.radiance_cache_samples < 1) {
+            throw std::runtime_error("cache_cell must be positive and cache_samples >= 1");
+        }
+
+        RenderJob job(camera.make_camera(settings.image_width, settings.image_height));
+        job.id = ++next_job_id;
+        job.scene = &scene_it->second;
+        job.settings = settings;
+        job.priority = priority;
+        job.out_path = fields["out"];
+        job.submitted = Clock::now();
+
+        // Streamed tiled output or a full framebuffer written as PPM at the end
+        const std::string tiled_extension = ".rtt";
+        std::unique_ptr<TiledImageWriter> writer;
+        if (job.out_path.size() > tiled_extension.size() &&
+            job.out_path.compare(job.out_path.size() - tiled_extension.size(),
+                                 tiled_extension.size(), tiled_extension) == 0) {
+            writer.reset(new TiledImageWriter(job.out_path, settings.image_width,
+                                              settings.image_height, tile_size));
+            job.writer = writer.get();
+        } else {
+            job.pixels.resize(static_cast<size_t>(settings.image_width) * settings.image_height);
+        }
+        // Open the PPM now so an unwritable path fails before any rendering
+        std::ofstream ppm_out;
+        if (!writer) {
+            ppm_out.open(job.out_path);
+            if (!ppm_out) throw std::runtime_error("cannot write " + job.out_path);
+        }
+
+        // Cached radiance depends on the scene and settings, so every job builds its own
+        std::unique_ptr<RadianceCache> radiance_cache;
+        if (settings.radiance_cache) {
+            radiance_cache.reset(new RadianceCache(settings.radiance_cache_cell,
+                                                   settings.radiance_cache_samples));
+            job.radiance_cache = radiance_cache.get();
+        }
+
+        run(job);
+        if (job.failed) {
+            // Drop the partial output, the tiled file would be incomplete anyway
+            writer.reset();
+            ppm_out.close();
+            std::remove(job.out_path.c_str());
+            throw std::runtime_error("render failed: " + job.error);
+        }
+
+        // Write the finished image
+        Clock::time_point write_start = Clock::now();
+        if (writer) {
+            writer->finish();
+        } else {
+            ppm_out << "P3\n" << settings.image_width << " " << settings.image_height << "\n255\n";
+            for (const auto& pixel : job.pixels) {
+                write_color(ppm_out, pixel, settings.samples_per_pixel);
+            }
+            ppm_out.close();
+            if (!ppm_out) throw std::runtime_error("cannot write " + job.out_path);
+        }
+        Clock::time_point write_end = Clock::now();
+
+        double queue_ms = elapsed_ms(job.submitted, job.render_start);
+        double render_ms = elapsed_ms(job.render_start, job.render_end);
+        double write_ms = elapsed_ms(write_start, write_end);
+        double total_ms = elapsed_ms(job.submitted, write_end);
+        record(render_ms, total_ms);
+
+        std::ostringstream reply;
+        reply << "ok job=" << job.id << " queue_ms=" << queue_ms << " render_ms=" << render_ms
+              << " write_ms=" << write_ms << " total_ms=" << total_ms;
+        std::cerr << "job " << job.id << " scene=" << fields["scene"] << " "
+                  << settings.image_width << "x" << settings.image_height << " spp="
+                  << settings.samples_per_pixel << ": " << reply.str().substr(3) << "\n";
+        if (radiance_cache) radiance_cache->print_stats(std::cerr);
+        // Shared by all jobs, so these are totals since startup
+        if (texture_cache->hit_count() + texture_cache->miss_count() > 0) {
+            texture_cache->print_stats(std::cerr);
+        }
+        return reply.str();
+    }
+
+    // Splits the job into tiles on the pool and waits for all of them to finish
+    void run(RenderJob& job) {
+        const RenderSettings& settings = job.settings;
+        int tiles_x = (settings.image_width + tile_size - 1) / tile_size;
+        int tiles_y = (settings.image_height + tile_size - 1) / tile_size;
+        int tile_count = tiles_x * tiles_y;
+        job.tiles_remaining = tile_count;
+
+        for (int ty = 0; ty < tiles_y; ++ty) {
+            for (int tx = 0; tx < tiles_x; ++tx) {
+                // Each node gets a contiguous band of tiles, idle nodes still steal
+                int node = (ty * tiles_x + tx) * pool->nodes() / tile_count;
+                pool->submit(job.priority, node, [&job, tx, ty, this]() {
+                    const RenderSettings& settings = job.settings;
+                    const Hittable& world = job.scene->world_on(ThreadPool::current_node());
+                    bool first = false;
+                    if (job.started.compare_exchange_strong(first, true)) {
+                        job.render_start = Clock::now();
+                    }
+
+                    int x0 = tx * tile_size, y0 = ty * tile_size;
+                    int x1 = std::min(x0 + tile_size, settings.image_width);
+                    int y1 = std::min(y0 + tile_size, settings.image_height);
+                    // A throwing tile fails its own job only, never the pool's workers
+                    try {
+                        if (job.failed) {
+                            // Skip the rest of a job that already failed
+                        } else if (job.writer) {
+                            // Render into a tile sized buffer freed as soon as it is written
+                            std::vector<Color> tile(static_cast<size_t>(x1 - x0) * (y1 - y0));
+                            render_tile(world, job.cam, settings, x0, y0, x1, y1,
+                                        tile.data(), x1 - x0, job.radiance_cache);
+                            job.writer->write_tile(tx, ty, tile.data(), x1 - x0,
+                                                   settings.samples_per_pixel);
+                        } else {
+                            render_tile(world, job.cam, settings, x0, y0, x1, y1,
+                                        &job.pixels[static_cast<size_t>(y0) * settings.image_width + x0],
+                                        settings.image_width, job.radiance_cache);
+                        }
+                    } catch (const std::exception& e) {
+                        std::lock_guard<std::mutex> lock(job.mutex);
+                        if (!job.failed) job.error = e.what();
+                        job.failed = true;
+                    }
+
+                    if (--job.tiles_remaining == 0) {
+                        std::lock_guard<std::mutex> lock(job.mutex);
+                        job.render_end = Clock::now();
+                        job.done = true;
+                        job.finished.notify_all();
+                    }
+                });
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(job.mutex);
+        job.finished.wait(lock, [&job]() { return job.done; });
+    }
+
+    void record(double render_ms, double total_ms) {
+        std::lock_guard<std::mutex> lock(metrics_mutex);
+        ++jobs_completed;
+        render_ms_sum += render_ms;
+        total_ms_sum += total_ms;
+        total_ms_max = std::max(total_ms_max, total_ms);
+    }
+
+    std::string stats() {
+        std::lock_guard<std::mutex> lock(metrics_mutex);
+        std::ostringstream reply;
+        reply << "ok jobs=" << jobs_completed
+              << " mean_render_ms=" << (jobs_completed ? render_ms_sum / jobs_completed : 0)
+              << " mean_total_ms=" << (jobs_completed ? total_ms_sum / jobs_completed : 0)
+              << " max_total_ms=" << total_ms_max
+              << " threads=" << pool->size() << " nodes=" << pool->nodes() << " scenes=" << scenes.size();
+
+        uint64_t hits = texture_cache->hit_count(), misses = texture_cache->miss_count();
+        reply << " texture_hits=" << hits << " texture_misses=" << misses
+              << " texture_hit_rate=" << (hits + misses ? 100.0 * hits / (hits + misses) : 0)
+              << " texture_resident_kib=" << texture_cache->resident_bytes() / 1024;
+        return reply.str();
+    }
+};
+
+// Serves request lines of one client connection until it disconnects
+void serve_connection(RenderDaemon& daemon, int client) {
+    std::string buffer;
+    char chunk[4096];
+    ssize_t n;
+    while ((n = read(client, chunk, sizeof(chunk))) > 0) {
+        buffer.append(chunk, n);
+        size_t newline;
+        while ((newline = buffer.find('\n')) != std::string::npos) {
+            std::string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            if (line.empty()) continue;
+
+            std::string reply = daemon.handle(line) + "\n";
+            if (write(client, reply.data(), reply.size()) < 0) break;
+        }
+    }
+    close(client);
+}
+
+// Returns true if a server accepts connections on the socket at address
+bool socket_in_use(const sockaddr_un& address) {
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) return false;
+    bool in_use = connect(probe, reinterpret_cast<const sockaddr*>(&address),
+                          sizeof(address)) == 0;
+    close(probe);
+    return in_use;
+}
+
+void remove_socket_and_exit(int) {
+    unlink(socket_path);
+    _exit(0);
+}
+
+void usage() {
+    std::cerr << "usage: renderd [--socket path] [--threads n] [--tile n] [--cache-dir dir] "
+              << "[--numa] [--numa-nodes n] [scene ...]\n"
+              << "Loads the given scenes (all by default) and serves render requests.\n"
+              << "With --cache-dir scenes are mapped from prebuilt scene cache files in dir,\n"
+              << "written on first use and rewritten when a scene's version changes.\n"
+              << "With --numa render threads are spread over NUMA nodes and pinned, cached\n"
+              << "scenes are replicated per node and tiles are scheduled node locally.\n"
+              << "--numa-nodes n implies --numa and regroups the cpus into n nodes, to\n"
+              << "exercise the NUMA paths on machines with fewer nodes.\n";
+}
+
+int main(int argc, char** argv) {
+    std::string path = default_socket_path;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int tile_size = 32;
+    std::string cache_dir;
+    bool numa = false;
+    int numa_nodes = 0;
+    std::vector<std::string> scene_names;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) path = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc) threads = std::max(1, atoi(argv[++i]));
+        else if (arg == "--tile" && i + 1 < argc) tile_size = std::max(1, atoi(argv[++i]));
+        else if (arg == "--cache-dir" && i + 1 < argc) cache_dir = argv[++i];
+        else if (arg == "--numa") numa = true;
+        else if (arg == "--numa-nodes" && i + 1 < argc) {
+            numa = true;
+            numa_nodes = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg[0] == '-') { usage(); return 1; }
+        else scene_names.push_back(arg);
+    }
+    if (path.size() >= sizeof(socket_path)) {
+        std::cerr << "Socket path too long: " << path << "\n";
+        return 1;
+    }
+
+    // Image texture tiles shared by all resident scenes, bounded to 256 MiB
+    auto texture_cache = make_shared<TextureCache>(256 << 20);
+    auto registry = scene_registry(texture_cache);
+    if (scene_names.empty()) {
+        for (const auto& entry : registry) scene_names.push_back(entry.first);
+    }
+
+    // Build every scene once up front, they stay resident for all jobs
+    std::map<std::string, ResidentScene> scenes;
+    for (const auto& name : scene_names) {
+        auto it = registry.find(name);
+        if (it == registry.end()) {
+            std::cerr << "Unknown scene: " << name << "\n";
+            return 1;
+        }
+        Clock::time_point start = Clock::now();
+        ResidentScene scene;
+        scene.camera = it->second.camera;
+        try {
+            if (cache_dir.empty()) {
+                scene.world = make_shared<HittableList>(it->second.build());
+            } else {
+                uint64_t key = scene_cache_key(name + "@" + std::to_string(it->second.version));
+                scene.world = cached_scene(cache_dir + "/" + name + ".rtscene", it->second.build,
+                                           key);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Skipping scene " << name << ": " << e.what() << "\n";
+            continue;
+        }
+        scenes[name] = scene;
+        std::cerr << "Loaded scene " << name << " in " << elapsed_ms(start, Clock::now())
+                  << " ms\n";
+    }
+
+    std::vector<std::vector<int>> node_cpus;
+    if (numa) {
+        node_cpus = numa_node_cpus();
+        if (numa_nodes > 0) node_cpus = split_node_cpus(node_cpus, numa_nodes);
+        Clock::time_point start = Clock::now();
+        replicate_per_node(scenes, node_cpus);
+        std::cerr << "Replicated scenes on " << node_cpus.size() << " NUMA nodes in "
+                  << elapsed_ms(start, Clock::now()) << " ms\n";
+    }
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path.c_str());
+    std::strcpy(socket_path, path.c_str());
+
+    // Replace a socket left behind by a previous daemon, but never a live one
+    if (socket_in_use(address)) {
+        std::cerr << "Another renderd is listening on " << path << "\n";
+        return 1;
+    }
+    unlink(socket_path);
+    if (server < 0 || bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(server, 64) < 0) {
+        std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, remove_socket_and_exit);
+    std::signal(SIGTERM, remove_socket_and_exit);
+
+    RenderDaemon daemon(std::move(scenes), texture_cache, threads, tile_size, node_cpus);
+    std::cerr << "Listening on " << path << " with " << threads << " render threads\n";
+
+    while (true) {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "accept failed: " << std::strerror(errno) << "\n";
+            break;
+        }
+        std::thread(serve_connection, std::ref(daemon), client).detach();
+    }
+
+    close(server);
+    unlink(socket_path);
+    return 1;
+}
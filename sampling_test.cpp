@@ -0,0 +1,197 @@
+#include "utility.h"
+
+#include "onb.h"
+
+#include <cstdio>
+#include <functional>
+#include <string>
+
+/*
+    Statistical checks of the direction samplers in vec3.h, of Onb and of the scattering
+    pdfs of the materials. Each sampler is drawn many times and a moment with a known
+    closed form is compared against the sample mean, allowing 5 standard errors. Exits
+    with 1 if any check fails.
+
+    Expected moments:
+        random_unit_vector       |r|^2 = 1, E[z] = 0, E[z^2] = 1/3, E[x] = E[y] = 0,
+                                 E[x^2] = 1/3, E[xy] = 0
+        random_in_unit_sphere    E[|r|^2] = 3/5  (radius density 3r^2)
+        random_in_hemisphere     E[cos] = 1/2, E[tangent component] = 0
+        random_in_unit_disk      E[|r|^2] = 1/2  (radius density 2r), z = 0,
+                                 E[x] = E[y] = 0, E[x^2] = 1/4, E[xy] = 0
+        random_cosine_direction  E[z] = 2/3      (pdf cos(theta)/pi), x and y as the disk
+    The x, y moments catch a wrong azimuth, which the radial moments cannot see.
+
+    Scattering pdfs must integrate to 1 over the sphere, checked with uniform directions
+    as E[4 pi pdf] = 1, and must match the directions scatter actually draws, checked with
+    E[pdf] over scattered directions = integral of pdf^2 (2 / (3 pi) for Lambertian).
+*/
+
+const int sample_count = 1000000;
+// Allowed rounding error of lengths and dot products
+const double eps = 1e-9;
+int failures = 0;
+
+// Compares the mean of f over the samples with expected, given f's standard deviation
+void check_mean(const char* name, std::function<double()> f, double expected, double stddev) {
+    double sum = 0;
+    for (int i = 0; i < sample_count; ++i) sum += f();
+    double mean = sum / sample_count;
+    double tolerance = 5 * stddev / std::sqrt(static_cast<double>(sample_count));
+    bool ok = fabs(mean - expected) <= tolerance;
+    if (!ok) ++failures;
+    std::printf("%s %-40s mean %.6f expected %.6f (+-%.6f)\n",
+                ok ? "ok  " : "FAIL", name, mean, expected, tolerance);
+}
+
+// Checks the azimuthal moments of a sampler whose projection onto the xy plane is
+// rotationally symmetric with E[x^2] = second, E[x^4] = fourth and E[x^2 y^2] = mixed
+void check_azimuth(const std::string& name, std::function<Vec3()> sample, double second,
+                   double fourth, double mixed) {
+    check_mean((name + " E[x]").c_str(), [&sample]() { return sample().x(); },
+               0.0, std::sqrt(second));
+    check_mean((name + " E[y]").c_str(), [&sample]() { return sample().y(); },
+               0.0, std::sqrt(second));
+    check_mean((name + " E[x^2]").c_str(), [&sample]() {
+        double x = sample().x();
+        return x * x;
+    }, second, std::sqrt(fourth - second * second));
+    check_mean((name + " E[xy]").c_str(), [&sample]() {
+        Vec3 d = sample();
+        return d.x() * d.y();
+    }, 0.0, std::sqrt(mixed));
+}
+
+// Hit record at the origin with a random normal, as seen by a material's scatter
+hit_record random_hit(shared_ptr<Material> mat) {
+    hit_record rec;
+    rec.p = Point3(0, 0, 0);
+    rec.normal = random_unit_vector();
+    rec.mat_ptr = mat;
+    rec.t = 1;
+    rec.u = rec.v = rec.uv_width = 0;
+    rec.inward = true;
+    return rec;
+}
+
+// Checks that a property holds for every sample up to rounding
+void check_all(const char* name, std::function<bool()> f) {
+    int bad = 0;
+    for (int i = 0; i < sample_count; ++i) {
+        if (!f()) ++bad;
+    }
+    if (bad > 0) ++failures;
+    std::printf("%s %-40s %d of %d samples violate it\n", bad == 0 ? "ok  " : "FAIL", name,
+                bad, sample_count);
+}
+
+int main() {
+    // Standard deviations follow from the distributions, e.g. z uniform in [-1, 1] has
+    // variance 1/3, and |r|^2 = t^(2/3) for t uniform has variance 3/7 - 9/25
+    check_all("random_unit_vector |r| = 1", []() {
+        return fabs(random_unit_vector().length() - 1) < eps;
+    });
+    check_mean("random_unit_vector E[z]", []() { return random_unit_vector().z(); },
+               0.0, std::sqrt(1.0 / 3));
+    check_mean("random_unit_vector E[z^2]", []() {
+        double z = random_unit_vector().z();
+        return z * z;
+    }, 1.0 / 3, std::sqrt(1.0 / 5 - 1.0 / 9));
+    // x and y of the sphere: E[x^4] = 1/5, E[x^2 y^2] = 1/15
+    check_azimuth("random_unit_vector", random_unit_vector, 1.0 / 3, 1.0 / 5, 1.0 / 15);
+
+    check_all("random_in_unit_sphere |r| <= 1", []() {
+        return random_in_unit_sphere().length_squared() <= 1 + eps;
+    });
+    check_mean("random_in_unit_sphere E[|r|^2]", []() {
+        return random_in_unit_sphere().length_squared();
+    }, 3.0 / 5, std::sqrt(3.0 / 7 - 9.0 / 25));
+
+    check_all("random_in_hemisphere |r| = 1, same side", []() {
+        Vec3 n = random_unit_vector();
+        Vec3 d = random_in_hemisphere(n);
+        return fabs(d.length() - 1) < eps && dot(d, n) >= 0;
+    });
+    check_mean("random_in_hemisphere E[cos]", []() {
+        Vec3 n = random_unit_vector();
+        return dot(random_in_hemisphere(n), n);
+    }, 1.0 / 2, std::sqrt(1.0 / 3 - 1.0 / 4));
+    check_mean("random_in_hemisphere E[tangent]", []() {
+        Vec3 n = random_unit_vector();
+        return dot(random_in_hemisphere(n), Onb(n).u);
+    }, 0.0, std::sqrt(1.0 / 3));
+
+    check_all("random_in_unit_disk |r| <= 1, z = 0", []() {
+        Vec3 p = random_in_unit_disk();
+        return p.length_squared() <= 1 + eps && p.z() == 0;
+    });
+    check_mean("random_in_unit_disk E[|r|^2]", []() {
+        return random_in_unit_disk().length_squared();
+    }, 1.0 / 2, std::sqrt(1.0 / 3 - 1.0 / 4));
+    // x = r cos(phi) with E[r^2] = 1/2, E[r^4] = 1/3: E[x^4] = 1/8, E[x^2 y^2] = 1/24
+    check_azimuth("random_in_unit_disk", random_in_unit_disk, 1.0 / 4, 1.0 / 8, 1.0 / 24);
+
+    check_all("random_cosine_direction |r| = 1, z >= 0", []() {
+        Vec3 d = random_cosine_direction();
+        return fabs(d.length() - 1) < eps && d.z() >= 0;
+    });
+    check_mean("random_cosine_direction E[z]", []() {
+        return random_cosine_direction().z();
+    }, 2.0 / 3, std::sqrt(1.0 / 2 - 4.0 / 9));
+    // Malley's method projects onto the disk, so x and y follow the disk moments
+    check_azimuth("random_cosine_direction", random_cosine_direction,
+                  1.0 / 4, 1.0 / 8, 1.0 / 24);
+
+    // Half the normals lie along or against an axis, where naive bases degenerate
+    check_all("Onb orthonormal and right handed", []() {
+        Vec3 n = random_unit_vector();
+        int axis = static_cast<int>(random_double() * 12);
+        if (axis < 6) {
+            n = Vec3(0, 0, 0);
+            n[axis / 2] = axis % 2 ? -1 : 1;
+        }
+        Onb b(n);
+        return fabs(b.u.length() - 1) < eps && fabs(b.v.length() - 1) < eps &&
+               fabs(dot(b.u, b.v)) < eps && fabs(dot(b.u, b.w)) < eps &&
+               fabs(dot(b.v, b.w)) < eps && (cross(b.u, b.v) - b.w).length() < eps;
+    });
+    check_mean("Onb local cosine sample E[dot(d, n)]", []() {
+        Vec3 n = random_unit_vector();
+        return dot(Onb(n).local(random_cosine_direction()), n);
+    }, 2.0 / 3, std::sqrt(1.0 / 2 - 4.0 / 9));
+
+    auto lambertian = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    auto isotropic = make_shared<Isotropic>(Color(0.5, 0.5, 0.5));
+    Ray incoming(Point3(0, 0, 1), Vec3(0, 0, -1));
+
+    // pdf^2 is cos^2 / pi^2 over half the sphere, so E[(4 pi pdf)^2] = 8/3
+    check_mean("Lambertian pdf integrates to 1", [&]() {
+        hit_record rec = random_hit(lambertian);
+        Ray scattered(rec.p, random_unit_vector());
+        return 4 * pi * lambertian->scattering_pdf(incoming, rec, scattered);
+    }, 1.0, std::sqrt(8.0 / 3 - 1));
+    // Second moment is the integral of pdf^3, 1 / (2 pi^2)
+    check_mean("Lambertian pdf matches scatter", [&]() {
+        hit_record rec = random_hit(lambertian);
+        Ray scattered;
+        Color attenuation;
+        lambertian->scatter(incoming, rec, attenuation, scattered);
+        return lambertian->scattering_pdf(incoming, rec, scattered);
+    }, 2 / (3 * pi), std::sqrt(1 / (2 * pi * pi) - 4 / (9 * pi * pi)));
+
+    check_mean("Isotropic pdf integrates to 1", [&]() {
+        hit_record rec = random_hit(isotropic);
+        Ray scattered(rec.p, random_unit_vector());
+        return 4 * pi * isotropic->scattering_pdf(incoming, rec, scattered);
+    }, 1.0, 1e-6);
+    check_mean("Isotropic scatter E[cos]", [&]() {
+        hit_record rec = random_hit(isotropic);
+        Ray scattered;
+        Color attenuation;
+        isotropic->scatter(incoming, rec, attenuation, scattered);
+        return dot(unit_vector(scattered.direction()), rec.normal);
+    }, 0.0, std::sqrt(1.0 / 3));
+
+    std::printf("%s\n", failures == 0 ? "All sampling checks passed" : "Sampling checks failed");
+    return failures == 0 ? 0 : 1;
+}
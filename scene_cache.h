@@ -0,0 +1,525 @@
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include "utility.h"
+
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+#include "texture.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+    Binary scene cache. A scene is flattened once into plain arrays (materials, spheres
+    and a bounding volume hierarchy over the spheres) and written to a versioned file.
+    Later runs map the file read-only and trace rays straight out of the mapped arrays:
+    there is no parsing, no per object allocation and no pointer fixups, since everything
+    refers to everything else by array index. Processes mapping the same file share its
+    pages through the page cache.
+
+    File layout, every section 8 byte aligned:
+        SceneCacheHeader
+        PackedMaterial[material_count]
+        PackedSphere[sphere_count]    ordered so every BVH leaf covers a contiguous range
+        PackedNode[node_count]        depth first, root at index 0
+
+    Every file is keyed by the scene name and definition version it was written from (see
+    SceneDescription in scenes.h), so bumping the version of an edited scene invalidates
+    its cache file instead of silently rendering the old scene.
+
+    Only spheres with Lambertian, Metal or Dielectric materials of solid colors can be
+    cached. The format stores raw doubles and integers, so cache files are only valid on
+    machines of the same endianness (checked on load).
+*/
+
+const char scene_cache_magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0'};
+const uint32_t scene_cache_version = 2;
+const uint32_t scene_cache_byte_order = 0x01020304;
+
+struct SceneCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    // Identifies the scene definition the file was written from
+    uint64_t scene_key;
+    uint64_t material_count;
+    uint64_t material_offset;
+    uint64_t sphere_count;
+    uint64_t sphere_offset;
+    uint64_t node_count;
+    uint64_t node_offset;
+    uint64_t file_size;
+};
+
+enum PackedMaterialType : uint32_t {
+    packed_lambertian = 0,
+    packed_metal = 1,
+    packed_dielectric = 2
+};
+
+struct PackedMaterial {
+    uint32_t type;
+    uint32_t padding;
+    double albedo[3];
+    // Fuzz of metals, refraction index of dielectrics
+    double parameter;
+};
+
+struct PackedSphere {
+    double center[3];
+    double radius;
+    uint32_t material;
+    uint32_t padding;
+};
+
+// Node of the BVH. Leaves (count > 0) cover spheres [first, first + count), interior
+// nodes have their left child right after them and their right child at index first
+struct PackedNode {
+    double bounds_min[3];
+    double bounds_max[3];
+    uint32_t first;
+    uint16_t count;
+    // Axis the children were split along, used to visit the nearer child first
+    uint16_t axis;
+};
+
+static_assert(sizeof(SceneCacheHeader) == 80, "scene cache header must have a fixed layout");
+static_assert(sizeof(PackedMaterial) == 40, "packed material must have a fixed layout");
+static_assert(sizeof(PackedSphere) == 40, "packed sphere must have a fixed layout");
+static_assert(sizeof(PackedNode) == 56, "packed node must have a fixed layout");
+
+// Returns the cache key of a scene definition, a FNV-1a hash of its description
+uint64_t scene_cache_key(const std::string& definition) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : definition) {
+        hash = (hash ^ c) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Spheres per BVH leaf
+const int scene_cache_leaf_size = 4;
+
+// Builds the BVH over spheres[first, last) by splitting at the median centroid along the
+// axis of largest centroid extent, reordering the spheres in place
+void build_bvh(std::vector<PackedSphere>& spheres, uint32_t first, uint32_t last,
+               std::vector<PackedNode>& nodes) {
+    size_t index = nodes.size();
+    nodes.push_back(PackedNode());
+
+    PackedNode node;
+    double centroid_min[3] = {infinity, infinity, infinity};
+    double centroid_max[3] = {-infinity, -infinity, -infinity};
+    for (int a = 0; a < 3; ++a) {
+        node.bounds_min[a] = infinity;
+        node.bounds_max[a] = -infinity;
+    }
+    for (uint32_t i = first; i < last; ++i) {
+        const PackedSphere& s = spheres[i];
+        double r = fabs(s.radius);
+        for (int a = 0; a < 3; ++a) {
+            node.bounds_min[a] = std::min(node.bounds_min[a], s.center[a] - r);
+            node.bounds_max[a] = std::max(node.bounds_max[a], s.center[a] + r);
+            centroid_min[a] = std::min(centroid_min[a], s.center[a]);
+            centroid_max[a] = std::max(centroid_max[a], s.center[a]);
+        }
+    }
+
+    int axis = 0;
+    for (int a = 1; a < 3; ++a) {
+        if (centroid_max[a] - centroid_min[a] > centroid_max[axis] - centroid_min[axis]) axis = a;
+    }
+    node.axis = static_cast<uint16_t>(axis);
+
+    if (last - first <= static_cast<uint32_t>(scene_cache_leaf_size)) {
+        node.first = first;
+        node.count = static_cast<uint16_t>(last - first);
+        nodes[index] = node;
+        return;
+    }
+
+    uint32_t middle = first + (last - first) / 2;
+    std::nth_element(spheres.begin() + first, spheres.begin() + middle, spheres.begin() + last,
+                     [axis](const PackedSphere& a, const PackedSphere& b) {
+                         return a.center[axis] < b.center[axis];
+                     });
+
+    build_bvh(spheres, first, middle, nodes);
+    node.first = static_cast<uint32_t>(nodes.size());
+    node.count = 0;
+    build_bvh(spheres, middle, last, nodes);
+    nodes[index] = node;
+}
+
+// Returns the solid color of a texture, throws if the texture varies over the surface
+Color packed_color(const shared_ptr<Texture>& texture) {
+    auto solid = std::dynamic_pointer_cast<SolidColor>(texture);
+    if (!solid) throw std::runtime_error("only solid color textures can be cached");
+    return solid->color;
+}
+
+/*
+    Flattens the scene into the contents of a cache file, held in 8 byte words so the
+    arrays are aligned in memory. Throws if the scene holds anything the cache format
+    cannot represent.
+*/
+std::vector<uint64_t> pack_scene(const HittableList& world, uint64_t key) {
+    std::vector<PackedMaterial> materials;
+    std::vector<PackedSphere> spheres;
+    std::map<const Material*, uint32_t> material_index;
+
+    for (const auto& object : world.objects) {
+        auto sphere = std::dynamic_pointer_cast<Sphere>(object);
+        if (!sphere) throw std::runtime_error("only spheres can be cached");
+
+        const Material* mat = sphere->mat_ptr.get();
+        auto found = material_index.find(mat);
+        if (found == material_index.end()) {
+            PackedMaterial packed;
+            std::memset(&packed, 0, sizeof(packed));
+            Color albedo(1.0, 1.0, 1.0);
+            if (auto lambertian = dynamic_cast<const Lambertian*>(mat)) {
+                packed.type = packed_lambertian;
+                albedo = packed_color(lambertian->albedo);
+            } else if (auto metal = dynamic_cast<const Metal*>(mat)) {
+                packed.type = packed_metal;
+                albedo = packed_color(metal->albedo);
+                packed.parameter = metal->fuzz;
+            } else if (auto dielectric = dynamic_cast<const Dielectric*>(mat)) {
+                packed.type = packed_dielectric;
+                packed.parameter = dielectric->refraction_index;
+            } else {
+                throw std::runtime_error("material cannot be cached");
+            }
+            for (int a = 0; a < 3; ++a) packed.albedo[a] = albedo[a];
+
+            found = material_index.insert(std::make_pair(mat, static_cast<uint32_t>(materials.size()))).first;
+            materials.push_back(packed);
+        }
+
+        PackedSphere packed;
+        std::memset(&packed, 0, sizeof(packed));
+        for (int a = 0; a < 3; ++a) packed.center[a] = sphere->center[a];
+        packed.radius = sphere->radius;
+        packed.material = found->second;
+        spheres.push_back(packed);
+    }
+
+    std::vector<PackedNode> nodes;
+    if (!spheres.empty()) {
+        build_bvh(spheres, 0, static_cast<uint32_t>(spheres.size()), nodes);
+    }
+
+    SceneCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, scene_cache_magic, sizeof(header.magic));
+    header.version = scene_cache_version;
+    header.byte_order = scene_cache_byte_order;
+    header.scene_key = key;
+    header.material_count = materials.size();
+    header.material_offset = sizeof(header);
+    header.sphere_count = spheres.size();
+    header.sphere_offset = header.material_offset + materials.size() * sizeof(PackedMaterial);
+    header.node_count = nodes.size();
+    header.node_offset = header.sphere_offset + spheres.size() * sizeof(PackedSphere);
+    header.file_size = header.node_offset + nodes.size() * sizeof(PackedNode);
+
+    std::vector<uint64_t> words(header.file_size / 8);
+    char* bytes = reinterpret_cast<char*>(words.data());
+    std::memcpy(bytes, &header, sizeof(header));
+    std::memcpy(bytes + header.material_offset, materials.data(),
+                materials.size() * sizeof(PackedMaterial));
+    std::memcpy(bytes + header.sphere_offset, spheres.data(), spheres.size() * sizeof(PackedSphere));
+    std::memcpy(bytes + header.node_offset, nodes.data(), nodes.size() * sizeof(PackedNode));
+    return words;
+}
+
+/*
+    Flattens the scene and writes it as a cache file. The file is written under a
+    temporary name and renamed into place, so other processes never map a partial file.
+    Throws if the scene holds anything the cache format cannot represent.
+*/
+void write_scene_cache(const HittableList& world, const std::string& path, uint64_t key) {
+    std::vector<uint64_t> words = pack_scene(world, key);
+
+    std::string temp_path = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream out(temp_path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint64_t));
+        if (!out) {
+            std::remove(temp_path.c_str());
+            throw std::runtime_error("cannot write " + temp_path);
+        }
+    }
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+/*
+    Scene traced directly out of a read-only mapped cache file. Only the small material
+    table is turned into Material objects on load, geometry and BVH stay in the mapping.
+
+    A scene can also be replicated into a private heap copy of the file contents. Made on a
+    thread pinned to a NUMA node, first touch places the copy (and its materials) in that
+    node's memory, so threads of every node can intersect against node local data. Packed
+    scenes hold the same contents built in memory, for one-off renders that want the BVH
+    without a cache file.
+*/
+class MappedScene : public Hittable {
+public:
+    MappedScene(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("cannot open scene cache " + path);
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SceneCacheHeader)) {
+            close(fd);
+            throw std::runtime_error("truncated scene cache " + path);
+        }
+        size = static_cast<size_t>(info.st_size);
+        data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) throw std::runtime_error("cannot map scene cache " + path);
+
+        if (!attach(static_cast<const char*>(data))) {
+            munmap(data, size);
+            throw std::runtime_error("stale or invalid scene cache " + path);
+        }
+    }
+
+    ~MappedScene() {
+        if (data) munmap(data, size);
+    }
+
+    MappedScene(const MappedScene&) = delete;
+    MappedScene& operator=(const MappedScene&) = delete;
+
+    // Returns a copy of the scene in memory allocated and first touched by the calling thread
+    shared_ptr<MappedScene> replicate() const {
+        shared_ptr<MappedScene> replica(new MappedScene());
+        replica->copy.resize((size + 7) / 8);
+        std::memcpy(replica->copy.data(), base, size);
+        replica->size = size;
+        replica->attach(reinterpret_cast<const char*>(replica->copy.data()));
+        return replica;
+    }
+
+    // Returns the scene flattened with its BVH in memory, without writing a cache file
+    static shared_ptr<MappedScene> pack(const HittableList& world) {
+        shared_ptr<MappedScene> packed(new MappedScene());
+        packed->copy = pack_scene(world, 0);
+        packed->size = packed->copy.size() * sizeof(uint64_t);
+        packed->attach(reinterpret_cast<const char*>(packed->copy.data()));
+        return packed;
+    }
+
+    size_t object_count() const { return sphere_count; }
+
+    // Key of the scene definition the file was written from
+    uint64_t key() const { return scene_key; }
+
+    virtual bool hit(const Ray& r, double t_min, double t_max, hit_record& rec) const override {
+        if (node_count == 0) return false;
+
+        Vec3 dir = r.direction();
+        Point3 origin = r.origin();
+        double inv_dir[3] = {1.0 / dir[0], 1.0 / dir[1], 1.0 / dir[2]};
+
+        double t_closest = t_max;
+        bool hit_anything = false;
+
+        // Depth first traversal, attach only accepts trees that fit the stack
+        uint32_t stack[traversal_stack_size];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const PackedNode& node = nodes[stack[--top]];
+            if (!hit_bounds(node, origin, inv_dir, t_min, t_closest)) continue;
+
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                    const PackedSphere& s = spheres[i];
+                    Point3 center(s.center[0], s.center[1], s.center[2]);
+                    if (Sphere::hit_sphere(center, s.radius, materials[s.material], r, t_min,
+                                           t_closest, rec)) {
+                        hit_anything = true;
+                        t_closest = rec.t;
+                    }
+                }
+            } else {
+                // Push the farther child first so the nearer one is visited first
+                uint32_t left = static_cast<uint32_t>(&node - nodes) + 1;
+                uint32_t right = node.first;
+                if (dir[node.axis] < 0) {
+                    stack[top++] = left;
+                    stack[top++] = right;
+                } else {
+                    stack[top++] = right;
+                    stack[top++] = left;
+                }
+            }
+        }
+
+        return hit_anything;
+    }
+
+private:
+    // Holds a pending sibling per level of the tree plus the two children just pushed
+    static const int traversal_stack_size = 64;
+
+    // Mapping of the cache file, null for replicas and packed scenes
+    void* data = nullptr;
+    // Private copy of the file contents of replicas and packed scenes
+    std::vector<uint64_t> copy;
+    size_t size;
+    const char* base;
+    const PackedSphere* spheres;
+    const PackedNode* nodes;
+    uint64_t sphere_count;
+    uint64_t node_count;
+    uint64_t scene_key;
+    std::vector<shared_ptr<Material>> materials;
+
+    MappedScene() {}
+
+    // Validates the file contents at bytes and points the scene into them. Every index is
+    // checked here so a corrupt or hostile file can never make hit read out of bounds.
+    bool attach(const char* bytes) {
+        if (size < sizeof(SceneCacheHeader)) return false;
+        const SceneCacheHeader* header = reinterpret_cast<const SceneCacheHeader*>(bytes);
+        if (std::memcmp(header->magic, scene_cache_magic, sizeof(header->magic)) != 0 ||
+            header->version != scene_cache_version || header->byte_order != scene_cache_byte_order ||
+            header->file_size != size ||
+            !valid_section(header->material_offset, header->material_count, sizeof(PackedMaterial)) ||
+            !valid_section(header->sphere_offset, header->sphere_count, sizeof(PackedSphere)) ||
+            !valid_section(header->node_offset, header->node_count, sizeof(PackedNode))) {
+            return false;
+        }
+
+        const PackedMaterial* packed = reinterpret_cast<const PackedMaterial*>(bytes + header->material_offset);
+        const PackedSphere* packed_spheres = reinterpret_cast<const PackedSphere*>(bytes + header->sphere_offset);
+        const PackedNode* packed_nodes = reinterpret_cast<const PackedNode*>(bytes + header->node_offset);
+        for (uint64_t i = 0; i < header->sphere_count; ++i) {
+            if (packed_spheres[i].material >= header->material_count) return false;
+        }
+        if (!valid_tree(packed_nodes, header->node_count, header->sphere_count)) return false;
+
+        std::vector<shared_ptr<Material>> unpacked;
+        try {
+            for (uint64_t i = 0; i < header->material_count; ++i) {
+                unpacked.push_back(unpack_material(packed[i]));
+            }
+        } catch (const std::exception&) {
+            return false;
+        }
+
+        base = bytes;
+        spheres = packed_spheres;
+        nodes = packed_nodes;
+        scene_key = header->scene_key;
+        sphere_count = header->sphere_count;
+        node_count = header->node_count;
+        materials.swap(unpacked);
+        return true;
+    }
+
+    // Checks that count elements of element_size at offset lie 8 byte aligned in the file,
+    // without overflowing on huge counts
+    bool valid_section(uint64_t offset, uint64_t count, size_t element_size) const {
+        return offset % 8 == 0 && offset >= sizeof(SceneCacheHeader) && offset <= size &&
+               count <= (size - offset) / element_size;
+    }
+
+    // Checks that leaves cover existing spheres and that children come after their parent,
+    // so traversal terminates, and that the tree fits the traversal stack of hit
+    static bool valid_tree(const PackedNode* nodes, uint64_t node_count, uint64_t sphere_count) {
+        if (node_count == 0) return sphere_count == 0;
+        std::vector<uint8_t> depth(node_count, 0);
+        for (uint64_t i = 0; i < node_count; ++i) {
+            const PackedNode& node = nodes[i];
+            if (node.count > 0) {
+                if (static_cast<uint64_t>(node.first) + node.count > sphere_count) return false;
+                continue;
+            }
+            if (node.axis > 2 || i + 1 >= node_count || node.first <= i + 1 ||
+                node.first >= node_count || depth[i] + 2 > traversal_stack_size) {
+                return false;
+            }
+            uint8_t child_depth = static_cast<uint8_t>(depth[i] + 1);
+            depth[i + 1] = std::max(depth[i + 1], child_depth);
+            depth[node.first] = std::max(depth[node.first], child_depth);
+        }
+        return true;
+    }
+
+    static shared_ptr<Material> unpack_material(const PackedMaterial& packed) {
+        Color albedo(packed.albedo[0], packed.albedo[1], packed.albedo[2]);
+        switch (packed.type) {
+            case packed_lambertian: return make_shared<Lambertian>(albedo);
+            case packed_metal: return make_shared<Metal>(albedo, packed.parameter);
+            case packed_dielectric: return make_shared<Dielectric>(packed.parameter);
+        }
+        throw std::runtime_error("unknown material type in scene cache");
+    }
+
+    // Slab test of the ray against the node bounds within [t_min, t_max]
+    static bool hit_bounds(const PackedNode& node, const Point3& origin, const double* inv_dir,
+                           double t_min, double t_max) {
+        for (int a = 0; a < 3; ++a) {
+            double t0 = (node.bounds_min[a] - origin[a]) * inv_dir[a];
+            double t1 = (node.bounds_max[a] - origin[a]) * inv_dir[a];
+            if (inv_dir[a] < 0) std::swap(t0, t1);
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if (t_max < t_min) return false;
+        }
+        return true;
+    }
+};
+
+/*
+    Returns the scene stored in the cache file at path, building it and writing the cache
+    first if the file is missing, was written by an incompatible version or holds another
+    definition of the scene than key. Scenes the cache cannot represent (textures, media)
+    are returned as built, uncached.
+*/
+shared_ptr<Hittable> cached_scene(const std::string& path, std::function<HittableList()> build,
+                                  uint64_t key) {
+    try {
+        auto mapped = make_shared<MappedScene>(path);
+        if (mapped->key() == key) return mapped;
+        std::cerr << "Scene cache " << path << " is from another scene definition, rebuilding\n";
+    } catch (const std::exception&) {
+        // Missing or from an older format, rebuild below
+    }
+
+    shared_ptr<HittableList> world = make_shared<HittableList>(build());
+    try {
+        write_scene_cache(*world, path, key);
+        return make_shared<MappedScene>(path);
+    } catch (const std::exception& e) {
+        std::cerr << "Not caching scene " << path << ": " << e.what() << "\n";
+        return world;
+    }
+}
+
+#endif
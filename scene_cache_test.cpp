@@ -0,0 +1,83 @@
+#include "utility.h"
+
+#include "scene_cache.h"
+#include "scenes.h"
+
+#include <cstdio>
+#include <string>
+#include <typeinfo>
+
+/*
+    Checks that scenes traced through the flattened BVH of scene_cache.h hit exactly what
+    the HittableList they were built from hits. Random rays, half of them aimed at a random
+    sphere so most of them hit something, are traced through both and must agree on
+    whether they hit, t, point, normal, side, surface coordinates and material type. The
+    in memory packed scene, a scene mapped from a written cache file and a replica of it
+    are all checked. Exits with 1 if any check fails.
+*/
+
+const int ray_count = 200000;
+int failures = 0;
+
+bool same_vec(const Vec3& a, const Vec3& b) {
+    return a.x() == b.x() && a.y() == b.y() && a.z() == b.z();
+}
+
+// Returns true if both records describe the same hit, bit for bit
+bool same_hit(const hit_record& a, const hit_record& b) {
+    return a.t == b.t && same_vec(a.p, b.p) && same_vec(a.normal, b.normal) &&
+           a.inward == b.inward && a.u == b.u && a.v == b.v && typeid(*a.mat_ptr) == typeid(*b.mat_ptr);
+}
+
+void check_scene(const std::string& name, const HittableList& world, const Hittable& packed) {
+    int mismatches = 0, hits = 0;
+    for (int i = 0; i < ray_count; ++i) {
+        Point3 origin = Point3::random(-15, 15);
+        Vec3 direction = random_unit_vector();
+        if (i % 2 == 0) {
+            auto target = std::dynamic_pointer_cast<Sphere>(
+                world.objects[static_cast<size_t>(random_double() * world.objects.size())]);
+            direction = target->center - origin;
+        }
+        Ray r(origin, direction);
+
+        hit_record expected, actual;
+        bool expected_hit = world.hit(r, 0.001, infinity, expected);
+        bool actual_hit = packed.hit(r, 0.001, infinity, actual);
+        if (expected_hit) {
+            expected.finish_surface_uv();
+            ++hits;
+        }
+        if (actual_hit) actual.finish_surface_uv();
+        if (expected_hit != actual_hit || (expected_hit && !same_hit(expected, actual))) {
+            ++mismatches;
+        }
+    }
+
+    if (mismatches > 0) ++failures;
+    std::printf("%s %-32s %d of %d rays disagree (%d hits)\n", mismatches == 0 ? "ok  " : "FAIL",
+                name.c_str(), mismatches, ray_count, hits);
+}
+
+int main() {
+    const char* path = "scene_cache_test.rtscene";
+    struct { const char* name; HittableList (*build)(); } scenes[] = {
+        {"random", random_scene}, {"metal", metal_scene}, {"glass", glass_scene},
+        {"diffuse", diffuse_scene}};
+
+    for (const auto& scene : scenes) {
+        HittableList world = scene.build();
+        std::string name = scene.name;
+        check_scene(name + " packed", world, *MappedScene::pack(world));
+
+        write_scene_cache(world, path, 1);
+        MappedScene mapped(path);
+        std::remove(path);
+        check_scene(name + " mapped", world, mapped);
+        check_scene(name + " replica", world, *mapped.replicate());
+    }
+
+    std::printf("%s\n", failures == 0 ? "All scene cache checks passed" :
+                                         "Scene cache checks failed");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,222 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "utility.h"
+
+#include "hittable_list.h"
+#include "sphere.h"
+#include "camera.h"
+#include "material.h"
+#include "texture.h"
+#include "medium.h"
+
+#include <functional>
+#include <map>
+#include <string>
+
+HittableList random_scene() {
+    HittableList world;
+
+    auto ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    world.add(make_shared<Sphere>(Point3(0,-1000,0), 1000, ground_material));
+
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            auto choose_mat = random_double();
+            Point3 center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
+
+            if ((center - Point3(4, 0.2, 0)).length() > 0.9) {
+                shared_ptr<Material> sphere_material;
+
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = Color::random() * Color::random();
+                    sphere_material = make_shared<Lambertian>(albedo);
+                    world.add(make_shared<Sphere>(center, 0.2, sphere_material));
+                } else if (choose_mat < 0.95) {
+                    // metal
+                    auto albedo = Color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    sphere_material = make_shared<Metal>(albedo, fuzz);
+                    world.add(make_shared<Sphere>(center, 0.2, sphere_material));
+                } else {
+                    // glass
+                    sphere_material = make_shared<Dielectric>(1.5);
+                    world.add(make_shared<Sphere>(center, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    auto material1 = make_shared<Dielectric>(1.5);
+    world.add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
+
+    auto material2 = make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
+    world.add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
+
+    auto material3 = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
+    world.add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
+
+    return world;
+}
+
+HittableList metal_scene() {
+    HittableList world;
+
+    auto ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    world.add(make_shared<Sphere>(Point3(0,-1000.5,0), 1000, ground_material));
+
+    auto metal = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
+
+    world.add(make_shared<Sphere>(Point3(0.0, 0.0, 0.0), 0.5, metal));
+    world.add(make_shared<Sphere>(Point3(1.25, 0.0, 0.0), 0.5, metal));
+    world.add(make_shared<Sphere>(Point3(-1.25, 0.0, 0.0), 0.5, metal));
+
+    world.add(make_shared<Sphere>(Point3(0.0, 1.25, 0.0), 0.5, metal));
+    world.add(make_shared<Sphere>(Point3(-1.25, 1.25, 0.0), 0.5, metal));
+    world.add(make_shared<Sphere>(Point3(1.25, 1.25, 0.0), 0.5, metal));
+
+    return world;
+}
+
+HittableList glass_scene() {
+    HittableList world;
+
+    auto ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    world.add(make_shared<Sphere>(Point3(0,-1000.5,0), 1000, ground_material));
+
+    auto glass = make_shared<Dielectric>(1.5);
+    auto metal = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
+
+    world.add(make_shared<Sphere>(Point3(0.0, 0.0, 0.0), 0.5, glass));
+    world.add(make_shared<Sphere>(Point3(1.25, 0.0, 0.0), 0.5, glass));
+    world.add(make_shared<Sphere>(Point3(-1.25, 0.0, 0.0), 0.5, glass));
+
+    world.add(make_shared<Sphere>(Point3(0.0, -0.3, -1.0), 0.2, metal));
+    world.add(make_shared<Sphere>(Point3(-1.25, -0.3, -1.0), 0.2, metal));
+    world.add(make_shared<Sphere>(Point3(1.25, -0.3, -1.0), 0.2, metal));
+
+    return world;
+}
+
+HittableList diffuse_scene() {
+    HittableList world;
+
+    auto ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    world.add(make_shared<Sphere>(Point3(0,-1000.5,0), 1000, ground_material));
+
+    auto lambertian_1 = make_shared<Lambertian>(Color(1.0, 1.0, 1.0));
+    auto lambertian_2 = make_shared<Lambertian>(Color(0.0, 1.0, 0.0));
+    auto lambertian_3 = make_shared<Lambertian>(Color(1.0, 0.0, 0.0));
+
+    world.add(make_shared<Sphere>(Point3(0.0, 0.0, 0.0), 0.5, lambertian_1));
+    world.add(make_shared<Sphere>(Point3(1.1, 0.0, 0.0), 0.5, lambertian_2));
+    world.add(make_shared<Sphere>(Point3(-1.1, 0.0, 0.0), 0.5, lambertian_3));
+
+    return world;
+}
+
+HittableList texture_scene(shared_ptr<TextureCache> texture_cache) {
+    HittableList world;
+
+    auto ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    world.add(make_shared<Sphere>(Point3(0,-1000.5,0), 1000, ground_material));
+
+    // Previous renders wrapped around spheres as image textures
+    auto image_1 = make_shared<ImageTexture>("images/image_500_samples.ppm", texture_cache);
+    auto image_2 = make_shared<ImageTexture>("images/image_5000_samplese_600_width.ppm",
+                                             texture_cache);
+
+    world.add(make_shared<Sphere>(Point3(0.0, 0.0, 0.0), 0.5, make_shared<Lambertian>(image_1)));
+    world.add(make_shared<Sphere>(Point3(1.25, 0.0, 0.0), 0.5, make_shared<Metal>(image_2, 0.1)));
+    world.add(make_shared<Sphere>(Point3(-1.25, 0.0, 0.0), 0.5, make_shared<Lambertian>(image_2)));
+
+    return world;
+}
+
+HittableList fog_scene() {
+    HittableList world;
+
+    auto ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    world.add(make_shared<Sphere>(Point3(0,-1000.5,0), 1000, ground_material));
+
+    auto metal = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
+    world.add(make_shared<Sphere>(Point3(1.25, 0.0, 0.0), 0.5, metal));
+
+    // Ball of white fog and a ball of dark smoke of constant density
+    auto fog_boundary = make_shared<Sphere>(Point3(0.0, 0.0, 0.0), 0.5, metal);
+    world.add(make_shared<ConstantMedium>(fog_boundary, 2.0, Color(1.0, 1.0, 1.0)));
+    auto smoke_boundary = make_shared<Sphere>(Point3(-1.25, 0.0, 0.0), 0.5, metal);
+    world.add(make_shared<ConstantMedium>(smoke_boundary, 4.0, Color(0.2, 0.2, 0.2)));
+
+    return world;
+}
+
+HittableList smoke_scene() {
+    HittableList world;
+
+    auto ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    world.add(make_shared<Sphere>(Point3(0,-1000.5,0), 1000, ground_material));
+
+    auto metal = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
+    world.add(make_shared<Sphere>(Point3(1.25, 0.0, 0.0), 0.5, metal));
+
+    // Wispy smoke plume, dense near the center and broken up into swirls, fading out
+    // towards the edge of its bounding sphere
+    Point3 center(-0.25, 0.25, 0.0);
+    double radius = 0.75;
+    auto plume = [center, radius](const Point3& p) {
+        Vec3 d = p - center;
+        double falloff = 1.0 - d.length() / radius;
+        if (falloff <= 0) return 0.0;
+        double swirl = sin(9.0*d.x() + 4.0*sin(7.0*d.y())) * sin(8.0*d.z() + 5.0*d.y());
+        return 12.0 * falloff * std::max(swirl, 0.0);
+    };
+    auto grid = make_shared<DensityGrid>(center - Vec3(radius, radius, radius),
+                                         center + Vec3(radius, radius, radius),
+                                         64, 64, 64, plume);
+    auto boundary = make_shared<Sphere>(center, radius, metal);
+    world.add(make_shared<HeterogeneousMedium>(boundary, grid, Color(0.9, 0.9, 0.9)));
+
+    return world;
+}
+
+// Builder of a scene together with the camera it is viewed from by default
+struct SceneDescription {
+    std::function<HittableList()> build;
+    CameraSettings camera;
+    // Keys the scene's cache files, bump it whenever the builder changes the scene
+    int version;
+};
+
+/*
+    Returns builders for every named scene paired with its default camera. Scenes using
+    image textures load them through the given tile cache.
+*/
+std::map<std::string, SceneDescription> scene_registry(
+        shared_ptr<TextureCache> texture_cache) {
+    // Front view used by the small three sphere scenes
+    CameraSettings front;
+    front.look_from = Point3(0, 0.6, 2.5);
+    front.look_at = Point3(0, 0.6, 0);
+    front.vertical_fov = 60.0;
+
+    CameraSettings overview;
+    overview.look_from = Point3(13, 2, 3);
+    overview.look_at = Point3(0, 0, 0);
+    overview.vertical_fov = 20.0;
+    overview.aperture = 0.1;
+
+    std::map<std::string, SceneDescription> scenes;
+    scenes["random"] = SceneDescription{random_scene, overview, 1};
+    scenes["metal"] = SceneDescription{metal_scene, front, 1};
+    scenes["glass"] = SceneDescription{glass_scene, front, 1};
+    scenes["diffuse"] = SceneDescription{diffuse_scene, front, 1};
+    scenes["texture"] = SceneDescription{
+        [texture_cache]() { return texture_scene(texture_cache); }, front, 1};
+    scenes["fog"] = SceneDescription{fog_scene, front, 1};
+    scenes["smoke"] = SceneDescription{smoke_scene, front, 1};
+    return scenes;
+}
+
+#endif
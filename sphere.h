@@ -15,10 +15,35 @@ public:
     Sphere(Point3 c, double r, shared_ptr<Material> m) : center(c), radius(r), mat_ptr(m) {}
 
     // Returns whether ray hit sphere and populates pass-by-reference hit_record
-    virtual bool hit(const Ray&r, double t_min, double t_max, hit_record& rec) const override;
+    virtual bool hit(const Ray&r, double t_min, double t_max, hit_record& rec) const override {
+        return hit_sphere(center, radius, mat_ptr, r, t_min, t_max, rec);
+    }
+
+    // Ray intersection with a sphere given by its center, radius and material, shared with
+    // scenes that store spheres as plain data instead of Sphere objects
+    static bool hit_sphere(const Point3& center, double radius, const shared_ptr<Material>& mat_ptr,
+                           const Ray& r, double t_min, double t_max, hit_record& rec);
+
+private:
+    // Sets u and v of a sphere hit from its outward normal, deferred by hit_sphere
+    static void set_surface_uv(hit_record& rec) {
+        get_sphere_uv(rec.inward ? rec.normal : -rec.normal, rec.u, rec.v);
+    }
+
+    // Sets the (u, v) surface coordinates of a point p on the unit sphere
+    // u is the angle around the y axis from x = -1, v is the angle from y = -1 to y = +1
+    // both normalized to [0, 1]
+    static void get_sphere_uv(const Point3& p, double& u, double& v) {
+        double theta = acos(clamp(-p.y(), -1.0, 1.0));
+        double phi = atan2(-p.z(), p.x()) + pi;
+
+        u = phi / (2*pi);
+        v = theta / pi;
+    }
 };
 
-bool Sphere::hit(const Ray&r, double t_min, double t_max, hit_record& rec) const {
+bool Sphere::hit_sphere(const Point3& center, double radius, const shared_ptr<Material>& mat_ptr,
+                        const Ray& r, double t_min, double t_max, hit_record& rec) {
     double a = r.direction().length_squared();
     Vec3 vec_ac = r.origin() - center;
     double half_b = dot(r.direction(), vec_ac);
@@ -49,6 +74,11 @@ bool Sphere::hit(const Ray&r, double t_min, double t_max, hit_record& rec) const
     // Sets hit record with whether ray is inward or outward for coloring
     // and sets surface normal to always be opposite to ray direction
     rec.set_face_normal(r, outward_normal);
+    // Surface coordinates are only computed for the closest hit (see finish_surface_uv),
+    // the footprint is cheap enough to set right away
+    // A unit of v spans half the circumference of the sphere
+    rec.surface_uv = &Sphere::set_surface_uv;
+    rec.uv_width = r.width_at(rec.t) / (pi * fabs(radius));
     // Set hit record material pointer to point to material of sphere
     rec.mat_ptr = mat_ptr;
 
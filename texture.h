@@ -0,0 +1,144 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "utility.h"
+#include "texture_cache.h"
+
+#include <string>
+
+/*
+    Abstract class representing a texture, a color that varies over the surface of an object.
+    Textures are looked up with the (u, v) surface coordinates of a hit and the approximate
+    width of the ray footprint in (u, v) space so image textures can filter accordingly.
+*/
+class Texture {
+public:
+    virtual Color value(double u, double v, const Point3& p, double uv_width) const = 0;
+};
+
+// Texture of a single constant color
+class SolidColor : public Texture {
+public:
+    Color color;
+
+    SolidColor() {}
+
+    SolidColor(const Color& c) : color(c) {}
+
+    SolidColor(double r, double g, double b) : color(r, g, b) {}
+
+    virtual Color value(double u, double v, const Point3& p, double uv_width) const override {
+        return color;
+    }
+};
+
+/*
+    Texture mapped from an image. The image is kept as a tiled mip pyramid on disk and its
+    tiles are pulled in lazily through a TextureCache, so only the tiles and mip levels rays
+    actually touch take up memory. Lookups are trilinear: the mip level is picked from the
+    ray footprint and blended bilinearly within and between the two nearest levels.
+    u wraps around and v is clamped, matching the sphere parameterization.
+*/
+class ImageTexture : public Texture {
+public:
+    /*
+        Opens the tiled version of a PPM image, converting the image first if the tiled
+        file is missing, older than the image, or unreadable.
+
+        @param ppm_path Path of the source PPM image
+        @param cache Tile cache shared by all image textures
+    */
+    ImageTexture(const std::string& ppm_path, shared_ptr<TextureCache> cache)
+        : cache(cache) {
+        std::string tiled_path = ppm_path.substr(0, ppm_path.rfind('.')) + ".rtex";
+        struct stat ppm_stat, tiled_stat;
+        bool current = stat(tiled_path.c_str(), &tiled_stat) == 0 &&
+                       (stat(ppm_path.c_str(), &ppm_stat) != 0 ||
+                        tiled_stat.st_mtime >= ppm_stat.st_mtime);
+        if (current) {
+            try {
+                file = std::make_shared<TiledTextureFile>(tiled_path);
+            } catch (const std::exception&) {
+                // Corrupt or from an older version, rebuild below
+            }
+        }
+        if (!file) {
+            if (!build_tiled_texture(ppm_path, tiled_path)) {
+                throw std::runtime_error("Cannot convert texture " + ppm_path);
+            }
+            file = std::make_shared<TiledTextureFile>(tiled_path);
+        }
+        id = cache->register_texture();
+    }
+
+    virtual Color value(double u, double v, const Point3& p, double uv_width) const override {
+        // Pick the level where one texel roughly covers the footprint
+        double texels = uv_width * std::max(file->width, file->height);
+        double lod = texels > 1.0 ? std::log2(texels) : 0.0;
+        int last_level = static_cast<int>(file->levels.size()) - 1;
+        if (lod >= last_level) {
+            return bilinear(last_level, u, v);
+        }
+
+        int level = static_cast<int>(lod);
+        double f = lod - level;
+        Color fine = bilinear(level, u, v);
+        if (f == 0.0) return fine;
+        return (1.0 - f) * fine + f * bilinear(level + 1, u, v);
+    }
+
+private:
+    shared_ptr<TextureCache> cache;
+    shared_ptr<TiledTextureFile> file;
+    uint32_t id;
+
+    // Bilinearly filtered linear color of a mip level at (u, v)
+    Color bilinear(int l, double u, double v) const {
+        const TextureLevel& level = file->levels[l];
+
+        // Texel centers sit at half integer coordinates, image rows run top to bottom
+        double x = (u - std::floor(u)) * level.width - 0.5;
+        double y = (1.0 - clamp(v, 0.0, 1.0)) * level.height - 0.5;
+        double x_floor = std::floor(x), y_floor = std::floor(y);
+        double fx = x - x_floor, fy = y - y_floor;
+
+        int x0 = static_cast<int>(x_floor), y0 = static_cast<int>(y_floor);
+        int xs[2] = {wrap(x0, level.width), wrap(x0 + 1, level.width)};
+        int ys[2] = {std::max(y0, 0), std::min(y0 + 1, static_cast<int>(level.height) - 1)};
+
+        // The four texels almost always share a tile, so keep the last one fetched
+        std::shared_ptr<const TextureTile> tile;
+        uint32_t tile_index = ~0u;
+
+        Color result;
+        for (int j = 0; j < 2; ++j) {
+            for (int i = 0; i < 2; ++i) {
+                uint32_t tx = xs[i] / file->tile_size, ty = ys[j] / file->tile_size;
+                uint32_t index = level.first_tile + ty * level.tiles_x + tx;
+                if (index != tile_index) {
+                    tile = cache->tile(id, *file, index);
+                    tile_index = index;
+                }
+
+                uint32_t lx = xs[i] % file->tile_size, ly = ys[j] % file->tile_size;
+                const unsigned char* texel = &tile->texels[(ly * file->tile_size + lx) * 3];
+                double weight = (i ? fx : 1.0 - fx) * (j ? fy : 1.0 - fy);
+                result += weight * Color(decode(texel[0]), decode(texel[1]), decode(texel[2]));
+            }
+        }
+        return result;
+    }
+
+    static int wrap(int x, int size) {
+        x %= size;
+        return x < 0 ? x + size : x;
+    }
+
+    // Texels are stored gamma 2 encoded, returns the linear value of an 8-bit texel
+    static double decode(unsigned char c) {
+        double x = c / 255.0;
+        return x * x;
+    }
+};
+
+#endif
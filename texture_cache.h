@@ -0,0 +1,424 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+    Tiled mip-mapped texture files and a bounded-memory cache of their tiles.
+
+    A texture is converted once from a PPM image into a tiled file (.rtex) holding its
+    whole mip pyramid. Every level is cut into fixed size square tiles of 8-bit RGB texels
+    so any tile can be read from disk on its own. At render time only the tiles that rays
+    actually touch are loaded, and at most the cache capacity worth of them stay resident.
+
+    File layout (all integers little endian uint32):
+        magic "RTEX", version, width, height, tile_size, levels
+        per level: width, height, tiles_x, tiles_y, first_tile
+        tile data: tile_size*tile_size*3 bytes per tile, levels back to back, tiles in
+                   row major order, texels outside the level edge are padded
+*/
+
+const uint32_t texture_file_version = 1;
+const uint32_t texture_tile_size = 32;
+
+struct TextureLevel {
+    uint32_t width;
+    uint32_t height;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    // Index of the first tile of this level across the whole file
+    uint32_t first_tile;
+};
+
+// A single resident tile of texels, rgb interleaved
+struct TextureTile {
+    std::vector<unsigned char> texels;
+};
+
+// Reads a binary (P6) or ascii (P3) PPM image into rgb bytes
+// Returns false if the file could not be read
+bool read_ppm(const std::string& path, int& width, int& height,
+              std::vector<unsigned char>& rgb) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+
+    // Skips whitespace and # comments between header tokens
+    auto next_token = [&in](std::string& token) {
+        token.clear();
+        char c;
+        while (in.get(c)) {
+            if (c == '#') {
+                while (in.get(c) && c != '\n') {}
+            } else if (!isspace(static_cast<unsigned char>(c))) {
+                token += c;
+                break;
+            }
+        }
+        while (in.get(c) && !isspace(static_cast<unsigned char>(c))) token += c;
+        return !token.empty();
+    };
+
+    std::string magic, w, h, max_value;
+    if (!next_token(magic) || !next_token(w) || !next_token(h) || !next_token(max_value)) {
+        return false;
+    }
+    // Parses a non-negative decimal header or sample value, -1 if it is not one
+    auto to_int = [](const std::string& token) {
+        if (token.empty() || token.size() > 9 ||
+            token.find_first_not_of("0123456789") != std::string::npos) {
+            return -1;
+        }
+        return std::atoi(token.c_str());
+    };
+
+    // One byte samples only, and sides small enough that tile counts fit 32 bits
+    width = to_int(w);
+    height = to_int(h);
+    int max_sample = to_int(max_value);
+    if (width <= 0 || height <= 0 || width > 65536 || height > 65536 || max_sample <= 0 ||
+        max_sample > 255) {
+        return false;
+    }
+    double scale = 255.0 / max_sample;
+
+    rgb.resize(static_cast<size_t>(width) * height * 3);
+    if (magic == "P6") {
+        in.read(reinterpret_cast<char*>(rgb.data()), rgb.size());
+        if (static_cast<size_t>(in.gcount()) != rgb.size()) return false;
+        for (auto& c : rgb) {
+            if (c > max_sample) return false;
+            c = static_cast<unsigned char>(c * scale + 0.5);
+        }
+        return true;
+    }
+    if (magic == "P3") {
+        std::string value;
+        for (auto& c : rgb) {
+            int sample = next_token(value) ? to_int(value) : -1;
+            if (sample < 0 || sample > max_sample) return false;
+            c = static_cast<unsigned char>(sample * scale + 0.5);
+        }
+        return true;
+    }
+    return false;
+}
+
+// Returns the mip levels of a width x height texture down to a single texel
+std::vector<TextureLevel> texture_levels(uint32_t width, uint32_t height, uint32_t tile_size) {
+    std::vector<TextureLevel> levels;
+    uint32_t first_tile = 0;
+    while (true) {
+        TextureLevel level;
+        level.width = width;
+        level.height = height;
+        level.tiles_x = (width + tile_size - 1) / tile_size;
+        level.tiles_y = (height + tile_size - 1) / tile_size;
+        level.first_tile = first_tile;
+        levels.push_back(level);
+        first_tile += level.tiles_x * level.tiles_y;
+
+        if (width == 1 && height == 1) break;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return levels;
+}
+
+/*
+    Converts a PPM image into a tiled mip-mapped texture file. This is an offline step so
+    the source image is held in memory while the pyramid is built. Mip levels are box
+    filtered in linear space (texels are stored gamma 2 encoded like the rendered images).
+    The file is written under a temporary name and renamed into place, so other processes
+    never open a partial file.
+    Returns false if the image could not be read or the output could not be written.
+*/
+bool build_tiled_texture(const std::string& ppm_path, const std::string& out_path) {
+    int width, height;
+    std::vector<unsigned char> rgb;
+    if (!read_ppm(ppm_path, width, height, rgb)) return false;
+
+    const uint32_t tile_size = texture_tile_size;
+    std::vector<TextureLevel> levels = texture_levels(width, height, tile_size);
+
+    std::string temp_path = out_path + ".tmp" + std::to_string(getpid());
+    std::ofstream out(temp_path, std::ios::binary);
+    if (!out) return false;
+
+    auto write_u32 = [&out](uint32_t x) { out.write(reinterpret_cast<const char*>(&x), 4); };
+    out.write("RTEX", 4);
+    write_u32(texture_file_version);
+    write_u32(width);
+    write_u32(height);
+    write_u32(tile_size);
+    write_u32(static_cast<uint32_t>(levels.size()));
+    for (const auto& level : levels) {
+        write_u32(level.width);
+        write_u32(level.height);
+        write_u32(level.tiles_x);
+        write_u32(level.tiles_y);
+        write_u32(level.first_tile);
+    }
+
+    // Current level in linear space
+    std::vector<double> linear(rgb.size());
+    for (size_t i = 0; i < rgb.size(); ++i) {
+        double c = rgb[i] / 255.0;
+        linear[i] = c * c;
+    }
+
+    std::vector<unsigned char> tile(tile_size * tile_size * 3);
+    for (size_t l = 0; l < levels.size(); ++l) {
+        const TextureLevel& level = levels[l];
+
+        if (l > 0) {
+            // 2x2 box filter the previous level, edge texels of odd sizes are clamped
+            const TextureLevel& prev = levels[l-1];
+            std::vector<double> next(static_cast<size_t>(level.width) * level.height * 3);
+            for (uint32_t y = 0; y < level.height; ++y) {
+                for (uint32_t x = 0; x < level.width; ++x) {
+                    uint32_t x0 = std::min(2*x, prev.width - 1), x1 = std::min(2*x + 1, prev.width - 1);
+                    uint32_t y0 = std::min(2*y, prev.height - 1), y1 = std::min(2*y + 1, prev.height - 1);
+                    for (int c = 0; c < 3; ++c) {
+                        next[(y*level.width + x)*3 + c] = 0.25 * (
+                            linear[(y0*prev.width + x0)*3 + c] + linear[(y0*prev.width + x1)*3 + c] +
+                            linear[(y1*prev.width + x0)*3 + c] + linear[(y1*prev.width + x1)*3 + c]);
+                    }
+                }
+            }
+            linear.swap(next);
+        }
+
+        for (uint32_t ty = 0; ty < level.tiles_y; ++ty) {
+            for (uint32_t tx = 0; tx < level.tiles_x; ++tx) {
+                for (uint32_t y = 0; y < tile_size; ++y) {
+                    for (uint32_t x = 0; x < tile_size; ++x) {
+                        uint32_t sx = std::min(tx*tile_size + x, level.width - 1);
+                        uint32_t sy = std::min(ty*tile_size + y, level.height - 1);
+                        for (int c = 0; c < 3; ++c) {
+                            double value = std::sqrt(linear[(sy*level.width + sx)*3 + c]);
+                            tile[(y*tile_size + x)*3 + c] =
+                                static_cast<unsigned char>(255.0 * value + 0.5);
+                        }
+                    }
+                }
+                out.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+            }
+        }
+    }
+
+    out.close();
+    if (!out || std::rename(temp_path.c_str(), out_path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*
+    Read-only handle to a tiled texture file. Tiles are read with pread so any number of
+    threads can load tiles from the same file concurrently without sharing a file offset.
+*/
+class TiledTextureFile {
+public:
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_size;
+    std::vector<TextureLevel> levels;
+
+    TiledTextureFile(const std::string& path) {
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open texture " + path);
+        }
+
+        uint32_t header[6];
+        if (pread(fd, header, sizeof(header), 0) != sizeof(header) ||
+            std::memcmp(header, "RTEX", 4) != 0 || header[1] != texture_file_version ||
+            header[4] == 0 || header[5] == 0 || header[5] > 64) {
+            close(fd);
+            throw std::runtime_error("Invalid texture file " + path);
+        }
+        width = header[2];
+        height = header[3];
+        tile_size = header[4];
+
+        levels.resize(header[5]);
+        size_t levels_bytes = levels.size() * sizeof(TextureLevel);
+        if (pread(fd, levels.data(), levels_bytes, sizeof(header)) !=
+            static_cast<ssize_t>(levels_bytes)) {
+            close(fd);
+            throw std::runtime_error("Truncated texture file " + path);
+        }
+        data_offset = sizeof(header) + levels_bytes;
+
+        // Levels are derived from the size, so a file whose table disagrees is corrupt
+        std::vector<TextureLevel> expected = width > 0 && height > 0 ?
+            texture_levels(width, height, tile_size) : std::vector<TextureLevel>();
+        if (expected.size() != levels.size() ||
+            std::memcmp(expected.data(), levels.data(), levels_bytes) != 0) {
+            close(fd);
+            throw std::runtime_error("Invalid texture file " + path);
+        }
+
+        // Every tile must be present, so a tile read can never come up short
+        const TextureLevel& last = levels.back();
+        size_t tile_count = static_cast<size_t>(last.first_tile) + last.tiles_x * last.tiles_y;
+        struct stat st;
+        if (fstat(fd, &st) != 0 ||
+            static_cast<size_t>(st.st_size) < data_offset + tile_count * tile_bytes()) {
+            close(fd);
+            throw std::runtime_error("Truncated texture file " + path);
+        }
+    }
+
+    ~TiledTextureFile() { close(fd); }
+
+    TiledTextureFile(const TiledTextureFile&) = delete;
+    TiledTextureFile& operator=(const TiledTextureFile&) = delete;
+
+    size_t tile_bytes() const { return static_cast<size_t>(tile_size) * tile_size * 3; }
+
+    // Reads the tile with the given file wide index from disk
+    std::shared_ptr<TextureTile> load_tile(uint32_t tile) const {
+        auto result = std::make_shared<TextureTile>();
+        result->texels.resize(tile_bytes());
+        off_t offset = static_cast<off_t>(data_offset + static_cast<size_t>(tile) * tile_bytes());
+        if (pread(fd, result->texels.data(), tile_bytes(), offset) !=
+            static_cast<ssize_t>(tile_bytes())) {
+            throw std::runtime_error("Failed to read texture tile");
+        }
+        return result;
+    }
+
+private:
+    int fd;
+    size_t data_offset;
+};
+
+/*
+    Fixed-size LRU cache of texture tiles shared by every image texture and render thread.
+
+    The cache is split into shards by tile key, each with its own lock and LRU list, so
+    threads only contend when they touch tiles of the same shard. Tiles are loaded from disk
+    outside the shard lock and handed out as shared pointers, so a tile evicted while a
+    thread is still filtering from it stays alive until that lookup finishes.
+*/
+class TextureCache {
+public:
+    // Capacity is the total bytes of texel data kept resident across all shards
+    TextureCache(size_t capacity_bytes) : capacity(capacity_bytes), next_texture_id(0),
+                                          hits(0), misses(0), evictions(0), resident(0) {}
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    // Returns a new id which keeps tiles of different textures apart in the cache
+    uint32_t register_texture() { return next_texture_id++; }
+
+    // Returns the tile of texture id, loading it from file on a miss
+    std::shared_ptr<const TextureTile> tile(uint32_t texture_id, const TiledTextureFile& file,
+                                            uint32_t tile_index) {
+        uint64_t key = (static_cast<uint64_t>(texture_id) << 32) | tile_index;
+        Shard& shard = shards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end()) {
+                // Move to front of the LRU list
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                hits.fetch_add(1, std::memory_order_relaxed);
+                return it->second->tile;
+            }
+        }
+
+        misses.fetch_add(1, std::memory_order_relaxed);
+        std::shared_ptr<const TextureTile> loaded = file.load_tile(tile_index);
+        size_t bytes = loaded->texels.size();
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // Another thread may have loaded the same tile while this one was reading
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            return it->second->tile;
+        }
+
+        shard.lru.push_front(Entry{key, loaded});
+        shard.index[key] = shard.lru.begin();
+        shard.bytes += bytes;
+        resident.fetch_add(bytes, std::memory_order_relaxed);
+
+        // Evict least recently used tiles past this shard's share of the capacity,
+        // always keeping the tile just loaded
+        while (shard.bytes > capacity / shard_count && shard.lru.size() > 1) {
+            const Entry& victim = shard.lru.back();
+            size_t victim_bytes = victim.tile->texels.size();
+            shard.index.erase(victim.key);
+            shard.lru.pop_back();
+            shard.bytes -= victim_bytes;
+            resident.fetch_sub(victim_bytes, std::memory_order_relaxed);
+            evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        return loaded;
+    }
+
+    uint64_t hit_count() const { return hits.load(); }
+
+    uint64_t miss_count() const { return misses.load(); }
+
+    // Bytes of texel data currently resident
+    size_t resident_bytes() const { return resident.load(); }
+
+    // Writes hit rate and resident memory of the cache
+    void print_stats(std::ostream& out) const {
+        uint64_t h = hits.load(), m = misses.load();
+        double hit_rate = (h + m) > 0 ? 100.0 * h / (h + m) : 0.0;
+        out << "Texture cache: " << h << " hits, " << m << " misses ("
+            << hit_rate << "% hit rate), " << evictions.load() << " evictions, "
+            << resident.load() / 1024 << " KiB resident of " << capacity / 1024 << " KiB\n";
+    }
+
+private:
+    static const size_t shard_count = 16;
+
+    struct Entry {
+        uint64_t key;
+        std::shared_ptr<const TextureTile> tile;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru;
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+    };
+
+    size_t capacity;
+    Shard shards[shard_count];
+    std::atomic<uint32_t> next_texture_id;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> evictions;
+    std::atomic<size_t> resident;
+};
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "numa.h"
+
+/*
+    Fixed set of worker threads running tasks from priority queues. Tasks with a higher
+    priority run first and tasks of equal priority run in submission order, so a render
+    split into many tile tasks lets a later, more urgent render overtake it between tiles.
+
+    Workers can be grouped by NUMA node, each group pinned to its node's cpus with a queue
+    of its own. Tasks are submitted to a node and workers take tasks of their own node
+    first, only taking another node's task when it has a strictly higher priority or their
+    own queue is empty, so work stays node local without leaving cores idle. Each node
+    has its own lock and wakeup: a submit wakes one worker of the target node, or an idle
+    worker of another node if all of the target's are busy, and stealing workers only
+    try-lock other nodes' queues.
+*/
+class ThreadPool {
+public:
+    // Unpinned pool with a single queue
+    ThreadPool(int threads) : stopping(false), next_sequence(0) {
+        queues.emplace_back(new NodeQueue());
+        for (int i = 0; i < threads; ++i) {
+            workers.emplace_back([this]() { work(0); });
+        }
+    }
+
+    /*
+        Pool with workers spread round robin over NUMA nodes and pinned to them.
+
+        @param node_cpus Cpu ids of every node, as returned by numa_node_cpus()
+        @param threads Total number of workers
+    */
+    ThreadPool(const std::vector<std::vector<int>>& node_cpus, int threads)
+        : stopping(false), next_sequence(0) {
+        for (size_t node = 0; node < node_cpus.size(); ++node) {
+            queues.emplace_back(new NodeQueue());
+        }
+        for (int i = 0; i < threads; ++i) {
+            int node = i % static_cast<int>(node_cpus.size());
+            std::vector<int> cpus = node_cpus[node];
+            workers.emplace_back([this, node, cpus]() {
+                if (!pin_current_thread(cpus)) {
+                    // Written in one piece so reports of several workers do not interleave
+                    std::ostringstream message;
+                    message << "Cannot pin render thread to the cpus of NUMA node " << node
+                            << ", it runs unpinned\n";
+                    std::cerr << message.str();
+                }
+                work(node);
+            });
+        }
+    }
+
+    // Finishes every queued task and then joins the workers
+    ~ThreadPool() {
+        stopping = true;
+        for (auto& queue : queues) {
+            // Taking the lock orders the flag before the check of any worker about to sleep
+            { std::lock_guard<std::mutex> lock(queue->mutex); }
+            queue->wake.notify_all();
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(workers.size()); }
+
+    int nodes() const { return static_cast<int>(queues.size()); }
+
+    // Node of the calling worker thread, 0 for threads outside any pool
+    static int current_node() { return worker_node(); }
+
+    void submit(int priority, std::function<void()> task) {
+        submit(priority, 0, std::move(task));
+    }
+
+    void submit(int priority, int node, std::function<void()> task) {
+        NodeQueue& target = *queues[node];
+        bool idle_worker;
+        {
+            std::lock_guard<std::mutex> lock(target.mutex);
+            target.tasks.push(Task{priority, next_sequence++, std::move(task)});
+            target.top_priority = target.tasks.top().priority;
+            // Woken workers count as idle until they run, so compare with queued tasks
+            idle_worker = static_cast<size_t>(target.idle) >= target.tasks.size();
+        }
+        if (idle_worker) {
+            target.wake.notify_one();
+            return;
+        }
+
+        // Every worker of the node is busy, let an idle worker of another node steal it
+        for (auto& queue : queues) {
+            if (queue.get() == &target || queue->idle == 0) continue;
+            {
+                std::lock_guard<std::mutex> lock(queue->mutex);
+                if (static_cast<size_t>(queue->idle) <= queue->tasks.size()) continue;
+            }
+            queue->wake.notify_one();
+            return;
+        }
+    }
+
+private:
+    struct Task {
+        int priority;
+        uint64_t sequence;
+        std::function<void()> run;
+    };
+
+    // Orders the queue so its top is the highest priority, earliest submitted task
+    struct TaskOrder {
+        bool operator()(const Task& a, const Task& b) const {
+            if (a.priority != b.priority) return a.priority < b.priority;
+            return a.sequence > b.sequence;
+        }
+    };
+
+    // Tasks of one node with the lock and wakeup its workers sleep on
+    struct NodeQueue {
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::priority_queue<Task, std::vector<Task>, TaskOrder> tasks;
+        // Priority of the top task, readable without the lock so stealing workers only
+        // lock queues worth stealing from
+        std::atomic<int> top_priority{no_task};
+        // Workers of the node looking for or waiting for a task, changed under the lock
+        std::atomic<int> idle{0};
+
+        // Pops the top task, the lock must be held
+        Task pop() {
+            Task task = tasks.top();
+            tasks.pop();
+            top_priority = tasks.empty() ? no_task : tasks.top().priority;
+            return task;
+        }
+    };
+
+    static const int no_task = std::numeric_limits<int>::min();
+
+    // How long an idle worker waits before retrying queues it found locked
+    static std::chrono::milliseconds steal_retry() { return std::chrono::milliseconds(1); }
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<NodeQueue>> queues;
+    std::atomic<bool> stopping;
+    std::atomic<uint64_t> next_sequence;
+
+    static int& worker_node() {
+        thread_local int node = 0;
+        return node;
+    }
+
+    /*
+        Takes the next task for a worker of node, whose queue the caller has locked.
+        Other queues are only try-locked, so workers never wait on each other's locks;
+        contended is set if one of them was skipped because it was locked.
+    */
+    bool take(int node, Task& task, bool& contended) {
+        NodeQueue& own = *queues[node];
+        for (size_t other = 0; other < queues.size(); ++other) {
+            if (static_cast<int>(other) == node) continue;
+            NodeQueue& queue = *queues[other];
+            // Steal only what is more urgent than anything left on the own node
+            int own_top = own.tasks.empty() ? no_task : own.tasks.top().priority;
+            if (queue.top_priority <= own_top) continue;
+
+            std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+            if (!lock.owns_lock()) {
+                contended = true;
+                continue;
+            }
+            if (!queue.tasks.empty() && queue.tasks.top().priority > own_top) {
+                task = queue.pop();
+                return true;
+            }
+        }
+        if (own.tasks.empty()) return false;
+        task = own.pop();
+        return true;
+    }
+
+    void work(int node) {
+        worker_node() = node;
+        NodeQueue& own = *queues[node];
+        while (true) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(own.mutex);
+                // Counted before looking at other queues, so a task submitted to another
+                // node after the look always finds this worker idle and wakes it
+                ++own.idle;
+                while (true) {
+                    bool contended = false;
+                    if (take(node, task, contended)) break;
+                    // A skipped queue may still hold tasks, so only leave once all were seen
+                    if (stopping && !contended) {
+                        --own.idle;
+                        return;
+                    }
+                    if (contended) own.wake.wait_for(lock, steal_retry());
+                    else own.wake.wait(lock);
+                }
+                --own.idle;
+            }
+            task.run();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef TILE_OUTPUT_H
+#define TILE_OUTPUT_H
+
+#include "color.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+    Streaming tiled image output. Finished tiles are appended to the file as soon as they
+    are rendered, in whatever order they finish, and can be freed right away. Resident
+    memory is therefore proportional to the tiles in flight instead of the image size,
+    which matters for poster size renders where a full Color framebuffer (24 bytes per
+    pixel) would take gigabytes.
+
+    File layout (.rtt), integers little endian:
+        TiledImageHeader
+        tile data in completion order, each tile its width*height*3 bytes of 8-bit rgb
+        uint64 offset of every tile in row major tile order (the index)
+    The header is written with a zero index_offset first and patched once the index has
+    been appended, so an unfinished file is recognizable.
+*/
+
+const char tiled_image_magic[8] = {'R', 'T', 'T', 'I', 'L', 'E', 'S', '\0'};
+const uint32_t tiled_image_version = 1;
+
+struct TiledImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_size;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    uint64_t index_offset;
+};
+
+static_assert(sizeof(TiledImageHeader) == 40, "tiled image header must have a fixed layout");
+
+/*
+    Writer of a tiled image file, safe to call from many render threads at once.
+*/
+class TiledImageWriter {
+public:
+    TiledImageWriter(const std::string& path, int width, int height, int tile_size)
+        : out(path, std::ios::binary), path(path), failed(false) {
+        if (!out) throw std::runtime_error("cannot write " + path);
+
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, tiled_image_magic, sizeof(header.magic));
+        header.version = tiled_image_version;
+        header.width = width;
+        header.height = height;
+        header.tile_size = tile_size;
+        header.tiles_x = (width + tile_size - 1) / tile_size;
+        header.tiles_y = (height + tile_size - 1) / tile_size;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        offsets.assign(static_cast<size_t>(header.tiles_x) * header.tiles_y, 0);
+    }
+
+    TiledImageWriter(const TiledImageWriter&) = delete;
+    TiledImageWriter& operator=(const TiledImageWriter&) = delete;
+
+    /*
+        Quantizes and appends tile (tx, ty). pixels holds the summed samples of the tile's
+        pixels in row major order with the given row stride.
+    */
+    void write_tile(int tx, int ty, const Color* pixels, int stride, int samples_per_pixel) {
+        int x0 = tx * header.tile_size, y0 = ty * header.tile_size;
+        int w = std::min<int>(header.tile_size, header.width - x0);
+        int h = std::min<int>(header.tile_size, header.height - y0);
+
+        // Quantize outside the lock, only the append is serialized
+        std::vector<unsigned char> rgb(static_cast<size_t>(w) * h * 3);
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                color_to_rgb8(pixels[y * stride + x], samples_per_pixel,
+                              &rgb[(static_cast<size_t>(y) * w + x) * 3]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        offsets[static_cast<size_t>(ty) * header.tiles_x + tx] = static_cast<uint64_t>(out.tellp());
+        out.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+        failed = failed || !out;
+    }
+
+    // Appends the index and completes the header, throws if any write failed
+    void finish() {
+        std::lock_guard<std::mutex> lock(mutex);
+        header.index_offset = static_cast<uint64_t>(out.tellp());
+        out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.close();
+        if (failed || !out) throw std::runtime_error("failed writing " + path);
+    }
+
+private:
+    std::ofstream out;
+    std::string path;
+    TiledImageHeader header;
+    std::vector<uint64_t> offsets;
+    std::mutex mutex;
+    bool failed;
+};
+
+/*
+    Converts a tiled image file to a PPM image, one row of tiles at a time, so memory
+    stays at a single tile row regardless of image size.
+    Throws if the file is not a complete tiled image.
+*/
+void tiled_image_to_ppm(const std::string& in_path, std::ostream& out) {
+    std::ifstream in(in_path, std::ios::binary);
+    TiledImageHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, tiled_image_magic, sizeof(header.magic)) != 0 ||
+        header.version != tiled_image_version) {
+        throw std::runtime_error(in_path + " is not a tiled image");
+    }
+    if (header.index_offset == 0) {
+        throw std::runtime_error(in_path + " is incomplete, its render did not finish");
+    }
+
+    std::vector<uint64_t> offsets(static_cast<size_t>(header.tiles_x) * header.tiles_y);
+    in.seekg(header.index_offset);
+    if (!in.read(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(uint64_t))) {
+        throw std::runtime_error(in_path + " has a truncated tile index");
+    }
+
+    // P3 means colors are in ascii and 255 is max color value
+    out << "P3\n" << header.width << " " << header.height << "\n255\n";
+
+    std::vector<unsigned char> row(static_cast<size_t>(header.width) * header.tile_size * 3);
+    for (uint32_t ty = 0; ty < header.tiles_y; ++ty) {
+        uint32_t y0 = ty * header.tile_size;
+        uint32_t h = std::min(header.tile_size, header.height - y0);
+
+        // Gather the row of tiles into scanlines
+        std::vector<unsigned char> tile;
+        for (uint32_t tx = 0; tx < header.tiles_x; ++tx) {
+            uint32_t x0 = tx * header.tile_size;
+            uint32_t w = std::min(header.tile_size, header.width - x0);
+            tile.resize(static_cast<size_t>(w) * h * 3);
+            in.seekg(offsets[static_cast<size_t>(ty) * header.tiles_x + tx]);
+            if (!in.read(reinterpret_cast<char*>(tile.data()), tile.size())) {
+                throw std::runtime_error(in_path + " has a truncated tile");
+            }
+            for (uint32_t y = 0; y < h; ++y) {
+                std::memcpy(&row[(static_cast<size_t>(y) * header.width + x0) * 3],
+                            &tile[static_cast<size_t>(y) * w * 3], static_cast<size_t>(w) * 3);
+            }
+        }
+
+        for (size_t i = 0; i < static_cast<size_t>(header.width) * h; ++i) {
+            out << static_cast<int>(row[i*3]) << " " << static_cast<int>(row[i*3 + 1]) << " "
+                << static_cast<int>(row[i*3 + 2]) << "\n";
+        }
+    }
+}
+
+#endif
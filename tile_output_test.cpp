@@ -0,0 +1,82 @@
+#include "utility.h"
+
+#include "color.h"
+#include "tile_output.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+    Round trip check of the streaming tiled output in tile_output.h. A random framebuffer
+    is written with TiledImageWriter one tile at a time in shuffled order, like render
+    threads finish them, converted back with tiled_image_to_ppm and compared byte for byte
+    with the PPM that write_color produces from the same framebuffer. Image sizes cover
+    partial tiles on the right and bottom edges, exact multiples of the tile size and a
+    single tile larger than the image. Exits with 1 if any check fails.
+*/
+
+int failures = 0;
+
+// Writes the framebuffer the way renderd writes a PPM output
+std::string reference_ppm(const std::vector<Color>& pixels, int width, int height, int spp) {
+    std::ostringstream out;
+    out << "P3\n" << width << " " << height << "\n255\n";
+    for (const auto& pixel : pixels) write_color(out, pixel, spp);
+    return out.str();
+}
+
+// Writes the framebuffer as shuffled tiles and converts the tiled file back to PPM
+std::string tiled_ppm(const std::vector<Color>& pixels, int width, int height, int tile_size,
+                      int spp, const std::string& path) {
+    std::vector<std::pair<int, int>> tiles;
+    for (int ty = 0; ty < (height + tile_size - 1) / tile_size; ++ty) {
+        for (int tx = 0; tx < (width + tile_size - 1) / tile_size; ++tx) {
+            tiles.push_back(std::make_pair(tx, ty));
+        }
+    }
+    std::random_shuffle(tiles.begin(), tiles.end(),
+                        [](int n) { return static_cast<int>(random_double() * n); });
+
+    TiledImageWriter writer(path, width, height, tile_size);
+    for (const auto& tile : tiles) {
+        int x0 = tile.first * tile_size, y0 = tile.second * tile_size;
+        writer.write_tile(tile.first, tile.second, &pixels[static_cast<size_t>(y0) * width + x0],
+                          width, spp);
+    }
+    writer.finish();
+
+    std::ostringstream out;
+    tiled_image_to_ppm(path, out);
+    std::remove(path.c_str());
+    return out.str();
+}
+
+void check_round_trip(int width, int height, int tile_size) {
+    // Summed samples, some above 1 per sample to exercise clamping
+    const int spp = 4;
+    std::vector<Color> pixels(static_cast<size_t>(width) * height);
+    for (auto& pixel : pixels) pixel = Color::random(0, 1.2 * spp);
+
+    std::string expected = reference_ppm(pixels, width, height, spp);
+    std::string actual = tiled_ppm(pixels, width, height, tile_size, spp,
+                                   "tile_output_test.rtt");
+    bool ok = actual == expected;
+    if (!ok) ++failures;
+    std::printf("%s %dx%d image, %d pixel tiles\n", ok ? "ok  " : "FAIL", width, height,
+                tile_size);
+}
+
+int main() {
+    check_round_trip(37, 23, 8);
+    check_round_trip(32, 16, 8);
+    check_round_trip(5, 3, 16);
+    check_round_trip(64, 1, 7);
+    check_round_trip(1, 50, 4);
+
+    std::printf("%s\n", failures == 0 ? "All tile output checks passed" :
+                                         "Tile output checks failed");
+    return failures == 0 ? 0 : 1;
+}
@@ -1,10 +1,12 @@
 #ifndef UTILITY_H
 #define UTILITY_H
 
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <memory>
-#include <cstdlib>
+#include <random>
 
 // Constants
 
@@ -17,9 +19,19 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+// Returns the random number generator of the calling thread
+// Each thread gets its own generator (with its own seed) so render threads never contend
+// on shared generator state, and a single threaded render stays reproducible
+inline std::mt19937_64& random_generator() {
+    static std::atomic<uint64_t> streams(0);
+    thread_local std::mt19937_64 generator(0x9E3779B97F4A7C15ull * ++streams);
+    return generator;
+}
+
 // Returns random double within [0, 1)
 inline double random_double() {
-    return rand() / ((double)RAND_MAX + 1.0);
+    // Top 53 bits of the generator output scaled into [0, 1)
+    return (random_generator()() >> 11) * (1.0 / 9007199254740992.0);
 }
 
 // Returns random double within [min, max)
@@ -130,30 +130,48 @@ inline Vec3 unit_vector(Vec3 v) {
     return v / v.length();
 }
 
-// Returns a random vector within the unit sphere from the origin
+// Direct sampling routines
+// All samplers below are closed form (no rejection loops) so every call consumes a fixed
+// number of random draws and has no data dependent branches
+
+// Returns a random unit vector uniformly distributed on the surface of the unit sphere
+// By Archimedes' hat-box theorem z is uniform in [-1, 1] and the azimuth is uniform in [0, 2pi)
+Vec3 random_unit_vector() {
+    double z = 1.0 - 2.0*random_double();
+    double r = std::sqrt(fmax(0.0, 1.0 - z*z));
+    double phi = 2.0*pi*random_double();
+    return Vec3(r*cos(phi), r*sin(phi), z);
+}
+
+// Returns a random vector uniformly distributed within the unit sphere from the origin
+// Volume grows with radius cubed so the radius is the cube root of a uniform draw
 Vec3 random_in_unit_sphere() {
-    while (true) {
-        // Generate random vector in -1 to 1 box
-        Vec3 n = Vec3::random(-1, 1);
-        // Keep generating until vector has length less than 1
-        // Can disregard square root since equivalent as just squaring
-        if (n.length_squared() >= 1) continue;
-        return n;
-    }
+    return std::cbrt(random_double()) * random_unit_vector();
 }
 
-Vec3 random_unit_vector() {
-    return unit_vector(random_in_unit_sphere());
+// Returns a random unit vector uniformly distributed on the hemisphere around normal
+// Flips the sphere sample onto the normal's side with copysign instead of a branch
+Vec3 random_in_hemisphere(const Vec3& normal) {
+    Vec3 v = random_unit_vector();
+    return std::copysign(1.0, dot(v, normal)) * v;
+}
+
+// Returns a random unit vector on the +z hemisphere distributed proportional to cos(theta)
+// (pdf = cos(theta) / pi), used for importance sampling Lambertian scattering
+// Projects a uniform disk sample up onto the hemisphere (Malley's method)
+Vec3 random_cosine_direction() {
+    double r2 = random_double();
+    double r = std::sqrt(r2);
+    double phi = 2.0*pi*random_double();
+    return Vec3(r*cos(phi), r*sin(phi), std::sqrt(1.0 - r2));
 }
 
-// Returns random vector in unit disk from origin with length smaller than 1
+// Returns random vector in unit disk (z = 0) from origin with length smaller than 1
+// Area grows with radius squared so the radius is the square root of a uniform draw
 Vec3 random_in_unit_disk() {
-    while (true) {
-        Vec3 v = Vec3(random_double(-1, 1), random_double(-1, 1), 0);
-        // Keep generating until vector has length less than 1
-        if (v.length_squared() >= 1) continue;
-        return v;
-    }
+    double r = std::sqrt(random_double());
+    double phi = 2.0*pi*random_double();
+    return Vec3(r*cos(phi), r*sin(phi), 0);
 }
 
 // Returns the reflected ray direction given an incoming ray and normal